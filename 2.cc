@@ -34,6 +34,7 @@
 #include "ns3/mobility-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/yans-wifi-helper.h"
+#include "ns3/spectrum-wifi-helper.h"
 #include "ns3/ssid.h"
 #include "ns3/netanim-module.h"
 #include "ns3/flow-monitor.h"
@@ -42,12 +43,30 @@
 #include "ns3/on-off-helper.h"
 #include "ns3/propagation-loss-model.h"
 #include "ns3/propagation-delay-model.h"
+#include "scratch/child-processes.h"
+#include "scratch/static-neighbour-channel.h"
+#include "scratch/table-error-rate-model.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <unistd.h>
 
 using namespace ns3;
 using namespace std;
 
-/// Run single 10 seconds experiment
-void experiment (bool enableCtsRts, string wifiManager)
+/**
+ * Run single 10 seconds experiment
+ *
+ * In quiet mode neither the NetAnim trace nor the per flow statistics
+ * are written, only the returned totals are collected. With
+ * staticChannel the PHYs share a StaticNeighbourSpectrumChannel,
+ * which precomputes every link budget of the fixed topology, instead
+ * of a YansWifiChannel. With tableErrorRate the PHYs use a
+ * TableDsssErrorRateModel.
+ */
+ExperimentSummary experiment (bool enableCtsRts, string wifiManager, bool quiet, bool staticChannel,
+                              bool tableErrorRate)
 {
   // 0. Enable or disable CTS/RTS
   UintegerValue ctsThr = (enableCtsRts ? UintegerValue (100) : UintegerValue (2200));
@@ -72,21 +91,41 @@ void experiment (bool enableCtsRts, string wifiManager)
   // lossModel->SetLoss (nodes.Get (0)->GetObject<MobilityModel> (), nodes.Get (1)->GetObject<MobilityModel> (), 50); // set symmetric loss 0 <-> 1 to 50 dB
   // lossModel->SetLoss (nodes.Get (2)->GetObject<MobilityModel> (), nodes.Get (1)->GetObject<MobilityModel> (), 50); // set symmetric loss 2 <-> 1 to 50 dB
 
-  // 4. Create & setup wifi channel
-  Ptr<YansWifiChannel> wifiChannel = CreateObject <YansWifiChannel> ();
-
-  wifiChannel->SetPropagationLossModel (lossModel);
-  wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
-
-  // 5. Install wireless devices
+  // 4. Create & setup wifi channel & 5. Install wireless devices
   WifiHelper wifi;
   wifi.SetStandard (WIFI_PHY_STANDARD_80211b);
   wifi.SetRemoteStationManager ("ns3::" + wifiManager + "WifiManager");
-  YansWifiPhyHelper wifiPhy =  YansWifiPhyHelper::Default ();
-  wifiPhy.SetChannel (wifiChannel);
   WifiMacHelper wifiMac;
   wifiMac.SetType ("ns3::AdhocWifiMac"); // use ad-hoc MAC
-  NetDeviceContainer devices = wifi.Install (wifiPhy, wifiMac, nodes);
+  NetDeviceContainer devices;
+  if (staticChannel)
+    {
+      Ptr<StaticNeighbourSpectrumChannel> wifiChannel = CreateObject<StaticNeighbourSpectrumChannel> ();
+      wifiChannel->AddPropagationLossModel (lossModel);
+      wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
+
+      SpectrumWifiPhyHelper wifiPhy = SpectrumWifiPhyHelper::Default ();
+      wifiPhy.SetChannel (wifiChannel);
+      if (tableErrorRate)
+        {
+          wifiPhy.SetErrorRateModel ("ns3::TableDsssErrorRateModel");
+        }
+      devices = wifi.Install (wifiPhy, wifiMac, nodes);
+    }
+  else
+    {
+      Ptr<YansWifiChannel> wifiChannel = CreateObject <YansWifiChannel> ();
+      wifiChannel->SetPropagationLossModel (lossModel);
+      wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
+
+      YansWifiPhyHelper wifiPhy =  YansWifiPhyHelper::Default ();
+      wifiPhy.SetChannel (wifiChannel);
+      if (tableErrorRate)
+        {
+          wifiPhy.SetErrorRateModel ("ns3::TableDsssErrorRateModel");
+        }
+      devices = wifi.Install (wifiPhy, wifiMac, nodes);
+    }
 
   // uncomment the following to have athstats output
   // AthstatsHelper athstats;
@@ -150,17 +189,21 @@ void experiment (bool enableCtsRts, string wifiManager)
 
   // 9. Run simulation for 10 seconds
   Simulator::Stop (Seconds (3));
-AnimationInterface anim("hidden.xml");
-
-anim.SetConstantPosition(nodes.Get(0),0.0,0.0);
-anim.SetConstantPosition(nodes.Get(1),10.0,0.0);
-// anim.SetConstantPosition(nodes.Get(2),20.0,0.0);
-  Simulator::Run ();
+  AnimationInterface *anim = 0;
+  if (!quiet)
+    {
+      anim = new AnimationInterface (enableCtsRts ? "hidden-rtscts.xml" : "hidden-basic.xml");
+      anim->SetConstantPosition (nodes.Get (0), 0.0, 0.0);
+      anim->SetConstantPosition (nodes.Get (1), 10.0, 0.0);
+      // anim->SetConstantPosition (nodes.Get (2), 20.0, 0.0);
+    }
+  TimedSimulatorRun ();
 
   // 10. Print per flow statistics
   monitor->CheckForLostPackets ();
   Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (flowmon.GetClassifier ());
   FlowMonitor::FlowStatsContainer stats = monitor->GetFlowStats ();
+  ExperimentSummary summary = { 0, 0, 0 };
   for (map<FlowId, FlowMonitor::FlowStats>::const_iterator i = stats.begin (); i != stats.end (); ++i)
     {
 
@@ -171,6 +214,13 @@ anim.SetConstantPosition(nodes.Get(1),10.0,0.0);
      //cout<<i->first<<endl;
       if (i->first)
         {
+          summary.txPackets += i->second.txPackets;
+          summary.rxPackets += i->second.rxPackets;
+          summary.rxBytes += i->second.rxBytes;
+          if (quiet)
+            {
+              continue;
+            }
           Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow (i->first);
           cout << "Flow " << i->first << " (" << t.sourceAddress << " -> " << t.destinationAddress << ")\n";
           cout << "  Tx Packets: " << i->second.txPackets << "\n";
@@ -186,6 +236,8 @@ anim.SetConstantPosition(nodes.Get(1),10.0,0.0);
 
   // 11. Cleanup
   Simulator::Destroy ();
+  delete anim;
+  return summary;
 }
 
 int main (int argc, char **argv)
@@ -193,13 +245,61 @@ int main (int argc, char **argv)
   string wifiManager ("Ideal");
   CommandLine cmd;
   cmd.AddValue ("wifiManager", "Set wifi rate manager (Aarf, Aarfcd, Amrr, Arf, Cara, Ideal, Minstrel, Onoe, Rraa)", wifiManager);
+  bool parallel = true;
+  cmd.AddValue ("parallel", "Run the RTS/CTS disabled and enabled experiments concurrently", parallel);
+  bool staticChannel = false;
+  cmd.AddValue ("staticChannel", "Use a spectrum channel that precomputes the link budgets of the static topology", staticChannel);
+  bool tableErrorRate = false;
+  cmd.AddValue ("tableErrorRate", "Look the DSSS/CCK chunk success rates up in precomputed tables (see ns3::TableDsssErrorRateModel)", tableErrorRate);
+  cmd.AddValue ("errorRateCache", "ns3::TableDsssErrorRateModel::CacheFile");
+  bool sweep = false;
+  uint32_t sweepRuns = 30;
+  uint32_t nWorkers = sysconf (_SC_NPROCESSORS_ONLN);
+  cmd.AddValue ("sweep", "Sweep all rate managers x RTS/CTS on/off x RngRun instead of a single experiment", sweep);
+  cmd.AddValue ("sweepRuns", "Number of RngRun values (1..sweepRuns) per sweep point", sweepRuns);
+  cmd.AddValue ("jobs", "Maximum number of concurrent sweep workers", nWorkers);
+  bool benchmark = false;
+  cmd.AddValue ("benchmark", "Time the RTS/CTS disabled experiment under every event scheduler", benchmark);
   cmd.Parse (argc, argv);
 
-  cout << "Hidden station experiment with RTS/CTS disabled:\n" << flush;
-  experiment (false, wifiManager);
+  if (tableErrorRate)
+    {
+      // built once here rather than in every child process
+      CreateObject<TableDsssErrorRateModel> ()->Prepare ();
+    }
+  if (benchmark)
+    {
+      BenchmarkSchedulers (bind (&experiment, false, wifiManager, true, staticChannel, tableErrorRate));
+      return 0;
+    }
+
+  if (sweep)
+    {
+      RunSweep ([=] (SweepJob const &job)
+                {
+                  return experiment (job.enableCtsRts, job.wifiManager, true, staticChannel, tableErrorRate);
+                }, sweepRuns, max (nWorkers, 1u));
+      return 0;
+    }
+
+  if (!parallel)
+    {
+      cout << "Hidden station experiment with RTS/CTS disabled:\n" << flush;
+      experiment (false, wifiManager, false, staticChannel, tableErrorRate);
+      cout << "------------------------------------------------\n";
+      cout << "Hidden station experiment with RTS/CTS enabled:\n";
+      experiment (true, wifiManager, false, staticChannel, tableErrorRate);
+      return 0;
+    }
+
+  vector<function<void ()> > jobs;
+  jobs.push_back (bind (&experiment, false, wifiManager, false, staticChannel, tableErrorRate));
+  jobs.push_back (bind (&experiment, true, wifiManager, false, staticChannel, tableErrorRate));
+  vector<string> output = RunInChildren (jobs);
+
+  cout << "Hidden station experiment with RTS/CTS disabled:\n" << output[0];
   cout << "------------------------------------------------\n";
-  cout << "Hidden station experiment with RTS/CTS enabled:\n";
-  experiment (true, wifiManager);
+  cout << "Hidden station experiment with RTS/CTS enabled:\n" << output[1];
 
   return 0;
 }
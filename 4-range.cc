@@ -5,6 +5,7 @@
 #include "ns3/mobility-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/yans-wifi-helper.h"
+#include "ns3/spectrum-wifi-helper.h"
 #include "ns3/ssid.h"
 #include "ns3/dsdv-module.h"
 #include "ns3/netanim-module.h"
@@ -14,12 +15,21 @@
 #include "ns3/on-off-helper.h"
 #include "ns3/propagation-loss-model.h"
 #include "ns3/propagation-delay-model.h"
+#include "scratch/grid-spectrum-channel.h"
 
 using namespace ns3;
 using namespace std;
 
-/// Run single 10 seconds experiment
-void experiment (bool enableCtsRts, string wifiManager)
+/**
+ * Run single 10 seconds experiment
+ *
+ * With gridChannel the PHYs share a GridSpectrumChannel instead of a
+ * YansWifiChannel. It buckets the nodes into cells as wide as the
+ * MaxRange of the RangePropagationLossModel, so a frame only looks at
+ * the nodes of the sender's cell and its eight neighbours, and only
+ * those within MaxRange get a receive event.
+ */
+void experiment (bool enableCtsRts, string wifiManager, bool gridChannel)
 {
   // 0. Enable or disable CTS/RTS
   UintegerValue ctsThr = (enableCtsRts ? UintegerValue (100) : UintegerValue (2200));
@@ -55,24 +65,36 @@ Config::SetDefault ("ns3::RangePropagationLossModel::MaxRange", DoubleValue (30)
   // lossModel->SetLoss (nodes.Get (2)->GetObject<MobilityModel> (), nodes.Get (1)->GetObject<MobilityModel> (), 50); // set symmetric loss 0 <-> 1 to 50 dB
   // lossModel->SetLoss (nodes.Get (2)->GetObject<MobilityModel> (), nodes.Get (3)->GetObject<MobilityModel> (), 50); // set symmetric loss 2 <-> 1 to 50 dB
 
-  // 4. Create & setup wifi channel
-  Ptr<YansWifiChannel> wifiChannel = CreateObject <YansWifiChannel> ();
-  wifiChannel->SetPropagationLossModel (lossModel);
-// wifiChannel.AddPropagationLoss ("ns3::FriisPropagationLossModel");
-
-  wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
-
-  // 5. Install wireless devices
+  // 4. Create & setup wifi channel & 5. Install wireless devices
   WifiHelper wifi;
   wifi.SetStandard (WIFI_PHY_STANDARD_80211b);
   wifi.SetRemoteStationManager ("ns3::" + wifiManager + "WifiManager");
-  YansWifiPhyHelper wifiPhy =  YansWifiPhyHelper::Default ();
-  wifiPhy.SetChannel (wifiChannel);
-  // wifiPhy.Set ("TxPowerStart",DoubleValue (7.5));
-  // wifiPhy.Set ("TxPowerEnd", DoubleValue (7.5));
   WifiMacHelper wifiMac;
   wifiMac.SetType ("ns3::AdhocWifiMac"); // use ad-hoc MAC
-  NetDeviceContainer devices = wifi.Install (wifiPhy, wifiMac, nodes);
+  NetDeviceContainer devices;
+  if (gridChannel)
+    {
+      Ptr<GridSpectrumChannel> wifiChannel = CreateObject<GridSpectrumChannel> ();
+      wifiChannel->AddPropagationLossModel (lossModel);
+      wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
+
+      SpectrumWifiPhyHelper wifiPhy = SpectrumWifiPhyHelper::Default ();
+      wifiPhy.SetChannel (wifiChannel);
+      devices = wifi.Install (wifiPhy, wifiMac, nodes);
+    }
+  else
+    {
+      Ptr<YansWifiChannel> wifiChannel = CreateObject <YansWifiChannel> ();
+      wifiChannel->SetPropagationLossModel (lossModel);
+      // wifiChannel.AddPropagationLoss ("ns3::FriisPropagationLossModel");
+      wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
+
+      YansWifiPhyHelper wifiPhy =  YansWifiPhyHelper::Default ();
+      wifiPhy.SetChannel (wifiChannel);
+      // wifiPhy.Set ("TxPowerStart",DoubleValue (7.5));
+      // wifiPhy.Set ("TxPowerEnd", DoubleValue (7.5));
+      devices = wifi.Install (wifiPhy, wifiMac, nodes);
+    }
 
 
   // 6. Install TCP/IP stack & assign IP addresses
@@ -197,13 +219,15 @@ int main (int argc, char **argv)
   string wifiManager ("Arf");
   CommandLine cmd;
   cmd.AddValue ("wifiManager", "Set wifi rate manager (Aarf, Aarfcd, Amrr, Arf, Cara, Ideal, Minstrel, Onoe, Rraa)", wifiManager);
+  bool gridChannel = false;
+  cmd.AddValue ("gridChannel", "Use a spectrum channel that only visits the nodes near the sender (see ns3::GridSpectrumChannel)", gridChannel);
   cmd.Parse (argc, argv);
 
   cout << "Exposed station experiment with RTS/CTS disabled:\n" << flush;
-  experiment (false, wifiManager);
+  experiment (false, wifiManager, gridChannel);
   cout << "------------------------------------------------\n";
   cout << "Exposed station experiment with RTS/CTS enabled:\n";
-  experiment (true, wifiManager);
+  experiment (true, wifiManager, gridChannel);
 
   return 0;
 }
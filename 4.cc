@@ -5,6 +5,7 @@
 #include "ns3/mobility-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/yans-wifi-helper.h"
+#include "ns3/spectrum-wifi-helper.h"
 #include "ns3/ssid.h"
 #include "ns3/dsdv-module.h"
 #include "ns3/netanim-module.h"
@@ -14,20 +15,45 @@
 #include "ns3/on-off-helper.h"
 #include "ns3/propagation-loss-model.h"
 #include "ns3/propagation-delay-model.h"
+#include "scratch/child-processes.h"
+#include "scratch/dense-matrix-propagation-loss-model.h"
+#include "scratch/event-profiler.h"
+#include "scratch/static-neighbour-channel.h"
+
+#include <functional>
+#include <map>
+#include <vector>
 
 using namespace ns3;
 using namespace std;
 
-/// Run single 10 seconds experiment
-void experiment (bool enableCtsRts, string wifiManager)
+/**
+ * Run single 10 seconds experiment
+ *
+ * nNodes nodes are laid out row by row on a grid gridWidth nodes wide.
+ * If lossFile is not empty the link losses are loaded from it instead
+ * of all being 0 dB. In quiet mode neither the NetAnim trace nor the
+ * per flow statistics are written. Unless profile is empty an event
+ * profile is written to profile-basic or profile-rtscts. With
+ * staticChannel the PHYs share a StaticNeighbourSpectrumChannel, which
+ * precomputes every link budget of the fixed grid, instead of a
+ * YansWifiChannel.
+ */
+void experiment (bool enableCtsRts, string wifiManager, uint32_t nNodes, uint32_t gridWidth, string lossFile, bool quiet,
+                 string profile, bool staticChannel)
 {
+  if (!profile.empty ())
+    {
+      EnableEventProfiling (profile + (enableCtsRts ? "-rtscts" : "-basic"));
+    }
+
   // 0. Enable or disable CTS/RTS
   UintegerValue ctsThr = (enableCtsRts ? UintegerValue (100) : UintegerValue (2200));
   Config::SetDefault ("ns3::WifiRemoteStationManager::RtsCtsThreshold", ctsThr);
 
   // 1. Create 3 nodes
   NodeContainer nodes;
-  nodes.Create (25);
+  nodes.Create (nNodes);
 
   // 2. Place nodes somehow, this is required by every wireless simulation
   // for (uint8_t i = 0; i < 4; ++i)
@@ -41,31 +67,48 @@ void experiment (bool enableCtsRts, string wifiManager)
                                  "MinY", DoubleValue (0.0),
                                  "DeltaX", DoubleValue (20.0),
                                  "DeltaY", DoubleValue (20.0),
-                                 "GridWidth", UintegerValue (5),
+                                 "GridWidth", UintegerValue (gridWidth),
                                  "LayoutType", StringValue ("RowFirst"));
   mobility1.Install(nodes);
 
   // 3. Create propagation loss matrix
-  Ptr<MatrixPropagationLossModel> lossModel = CreateObject<MatrixPropagationLossModel> ();
+  Ptr<DenseMatrixPropagationLossModel> lossModel = CreateObject<DenseMatrixPropagationLossModel> ();
   lossModel->SetDefaultLoss (0); // set default loss to 200 dB (no link)
+  if (!lossFile.empty ())
+    {
+      lossModel->LoadFromFile (lossFile, nodes);
+    }
   // lossModel->SetLoss (nodes.Get (1)->GetObject<MobilityModel> (), nodes.Get (0)->GetObject<MobilityModel> (), 50); // set symmetric loss 0 <-> 1 to 50 dB
   // lossModel->SetLoss (nodes.Get (2)->GetObject<MobilityModel> (), nodes.Get (1)->GetObject<MobilityModel> (), 50); // set symmetric loss 0 <-> 1 to 50 dB
   // lossModel->SetLoss (nodes.Get (2)->GetObject<MobilityModel> (), nodes.Get (3)->GetObject<MobilityModel> (), 50); // set symmetric loss 2 <-> 1 to 50 dB
 
-  // 4. Create & setup wifi channel
-  Ptr<YansWifiChannel> wifiChannel = CreateObject <YansWifiChannel> ();
-  wifiChannel->SetPropagationLossModel (lossModel);
-  wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
-
-  // 5. Install wireless devices
+  // 4. Create & setup wifi channel & 5. Install wireless devices
   WifiHelper wifi;
   wifi.SetStandard (WIFI_PHY_STANDARD_80211b);
   wifi.SetRemoteStationManager ("ns3::" + wifiManager + "WifiManager");
-  YansWifiPhyHelper wifiPhy =  YansWifiPhyHelper::Default ();
-  wifiPhy.SetChannel (wifiChannel);
   WifiMacHelper wifiMac;
   wifiMac.SetType ("ns3::AdhocWifiMac"); // use ad-hoc MAC
-  NetDeviceContainer devices = wifi.Install (wifiPhy, wifiMac, nodes);
+  NetDeviceContainer devices;
+  if (staticChannel)
+    {
+      Ptr<StaticNeighbourSpectrumChannel> wifiChannel = CreateObject<StaticNeighbourSpectrumChannel> ();
+      wifiChannel->AddPropagationLossModel (lossModel);
+      wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
+
+      SpectrumWifiPhyHelper wifiPhy = SpectrumWifiPhyHelper::Default ();
+      wifiPhy.SetChannel (wifiChannel);
+      devices = wifi.Install (wifiPhy, wifiMac, nodes);
+    }
+  else
+    {
+      Ptr<YansWifiChannel> wifiChannel = CreateObject <YansWifiChannel> ();
+      wifiChannel->SetPropagationLossModel (lossModel);
+      wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
+
+      YansWifiPhyHelper wifiPhy =  YansWifiPhyHelper::Default ();
+      wifiPhy.SetChannel (wifiChannel);
+      devices = wifi.Install (wifiPhy, wifiMac, nodes);
+    }
 
 
   // 6. Install TCP/IP stack & assign IP addresses
@@ -76,12 +119,12 @@ void experiment (bool enableCtsRts, string wifiManager)
   internet.Install (nodes);
   Ipv4AddressHelper ipv4;
   ipv4.SetBase ("10.0.0.0", "255.0.0.0");
-  ipv4.Assign (devices);
+  Ipv4InterfaceContainer interfaces = ipv4.Assign (devices);
 
   // 7. Install applications: two CBR streams each saturating the channel
   ApplicationContainer cbrApps;
   uint16_t cbrPort = 12345;
-  OnOffHelper onOffHelper1 ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address ("10.0.0.25"), cbrPort));
+  OnOffHelper onOffHelper1 ("ns3::UdpSocketFactory", InetSocketAddress (interfaces.GetAddress (nNodes - 1), cbrPort));
   onOffHelper1.SetAttribute ("PacketSize", UintegerValue (110));
   onOffHelper1.SetAttribute ("OnTime",  StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
   onOffHelper1.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
@@ -92,14 +135,14 @@ void experiment (bool enableCtsRts, string wifiManager)
   cbrApps.Add (onOffHelper1.Install (nodes.Get (0)));
 
   // flow 2:  node 2 -> node 1
-  OnOffHelper onOffHelper2 ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address ("10.0.0.5"), cbrPort));
+  OnOffHelper onOffHelper2 ("ns3::UdpSocketFactory", InetSocketAddress (interfaces.GetAddress (gridWidth - 1), cbrPort));
   onOffHelper2.SetAttribute ("PacketSize", UintegerValue (110));
   onOffHelper2.SetAttribute ("OnTime",  StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
   onOffHelper2.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
 
   onOffHelper2.SetAttribute ("DataRate", StringValue ("3000000bps"));
   onOffHelper2.SetAttribute ("StartTime", TimeValue (Seconds (2.000000)));
-  cbrApps.Add (onOffHelper2.Install (nodes.Get (19)));
+  cbrApps.Add (onOffHelper2.Install (nodes.Get (nNodes - gridWidth - 1)));
 
   // flow 3:  node 2 -> node 3
   // OnOffHelper onOffHelper3 ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address ("10.0.0.4"), cbrPort));
@@ -146,13 +189,16 @@ void experiment (bool enableCtsRts, string wifiManager)
 
   // 9. Run simulation for 10 seconds
   Simulator::Stop (Seconds (10));
-AnimationInterface anim("exposed.xml");
-
-// anim.SetConstantPosition(nodes.Get(0),0.0,0.0);
-// anim.SetConstantPosition(nodes.Get(1),10.0,0.0);
-// anim.SetConstantPosition(nodes.Get(2),20.0,0.0);
-// anim.SetConstantPosition(nodes.Get(3),30.0,0.0);
-  Simulator::Run ();
+  AnimationInterface *anim = 0;
+  if (!quiet)
+    {
+      anim = new AnimationInterface (enableCtsRts ? "exposed-rtscts.xml" : "exposed-basic.xml");
+      // anim->SetConstantPosition (nodes.Get (0), 0.0, 0.0);
+      // anim->SetConstantPosition (nodes.Get (1), 10.0, 0.0);
+      // anim->SetConstantPosition (nodes.Get (2), 20.0, 0.0);
+      // anim->SetConstantPosition (nodes.Get (3), 30.0, 0.0);
+    }
+  TimedSimulatorRun ();
 
   // 10. Print per flow statistics
   monitor->CheckForLostPackets ();
@@ -166,7 +212,7 @@ AnimationInterface anim("exposed.xml");
       // and
       //   Simulator::Stops at "second 10".
      //cout<<i->first<<endl;
-      if (i->first)
+      if (i->first && !quiet)
         {
           Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow (i->first);
           cout << "Flow " << i->first << " (" << t.sourceAddress << " -> " << t.destinationAddress << ")\n";
@@ -183,6 +229,7 @@ AnimationInterface anim("exposed.xml");
 
   // 11. Cleanup
   Simulator::Destroy ();
+  delete anim;
 }
 
 int main (int argc, char **argv)
@@ -190,13 +237,55 @@ int main (int argc, char **argv)
   string wifiManager ("Arf");
   CommandLine cmd;
   cmd.AddValue ("wifiManager", "Set wifi rate manager (Aarf, Aarfcd, Amrr, Arf, Cara, Ideal, Minstrel, Onoe, Rraa)", wifiManager);
+  uint32_t nNodes = 25;
+  uint32_t gridWidth = 5;
+  bool parallel = true;
+  cmd.AddValue ("nNodes", "Number of nodes in the grid", nNodes);
+  cmd.AddValue ("gridWidth", "Number of nodes per grid row", gridWidth);
+  string lossFile;
+  cmd.AddValue ("lossFile", "Load the nNodes x nNodes link loss matrix (dB) from this file", lossFile);
+  cmd.AddValue ("parallel", "Run the RTS/CTS disabled and enabled experiments concurrently", parallel);
+  bool staticChannel = false;
+  cmd.AddValue ("staticChannel", "Use a spectrum channel that precomputes the link budgets of the static grid", staticChannel);
+  cmd.AddValue ("batchWindow", "ns3::StaticNeighbourSpectrumChannel::BatchWindow");
+  bool benchmark = false;
+  cmd.AddValue ("benchmark", "Time the RTS/CTS disabled experiment under every event scheduler", benchmark);
+  string profile;
+  cmd.AddValue ("profile", "Write the wall time spent per event type to FILE-basic/-rtscts and a flamegraph input to FILE-*.folded", profile);
   cmd.Parse (argc, argv);
 
-  cout << "Exposed station experiment with RTS/CTS disabled:\n" << flush;
-  experiment (false, wifiManager);
+  // The echo clients use nodes 1 to 3 and the second CBR flow runs from
+  // the end of the second to last row to the end of the first one.
+  if (gridWidth < 1 || nNodes < gridWidth + 4)
+    {
+      std::cout << "nNodes should be at least gridWidth + 4" << std::endl;
+      return 1;
+    }
+
+  if (benchmark)
+    {
+      BenchmarkSchedulers (bind (&experiment, false, wifiManager, nNodes, gridWidth, lossFile, true, string (), staticChannel));
+      return 0;
+    }
+
+  if (!parallel)
+    {
+      cout << "Exposed station experiment with RTS/CTS disabled:\n" << flush;
+      experiment (false, wifiManager, nNodes, gridWidth, lossFile, false, profile, staticChannel);
+      cout << "------------------------------------------------\n";
+      cout << "Exposed station experiment with RTS/CTS enabled:\n";
+      experiment (true, wifiManager, nNodes, gridWidth, lossFile, false, profile, staticChannel);
+      return 0;
+    }
+
+  vector<function<void ()> > jobs;
+  jobs.push_back (bind (&experiment, false, wifiManager, nNodes, gridWidth, lossFile, false, profile, staticChannel));
+  jobs.push_back (bind (&experiment, true, wifiManager, nNodes, gridWidth, lossFile, false, profile, staticChannel));
+  vector<string> output = RunInChildren (jobs);
+
+  cout << "Exposed station experiment with RTS/CTS disabled:\n" << output[0];
   cout << "------------------------------------------------\n";
-  cout << "Exposed station experiment with RTS/CTS enabled:\n";
-  experiment (true, wifiManager);
+  cout << "Exposed station experiment with RTS/CTS enabled:\n" << output[1];
 
   return 0;
 }
@@ -0,0 +1,128 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Converts an AnimRecorder file (see anim-binary.h) into NetAnim XML:
+//
+//   ./waf --run "anim-bin2xml aodv.anim aodv.xml"
+//
+// Every reception of a sampled packet becomes one <p> element from the
+// transmitting node; the first and last bit times are the transmission
+// start and the reception end, as the binary file only has those.
+// Like the recorder, it remembers only the last ANIM_MAX_SAMPLED
+// transmitted uids, so its memory does not grow with the recording.
+
+#include "anim-binary.h"
+
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <unordered_map>
+
+int
+main (int argc, char *argv[])
+{
+  if (argc != 3)
+    {
+      std::cerr << "usage: anim-bin2xml IN OUT.xml" << std::endl;
+      return 1;
+    }
+  FILE *in = std::fopen (argv[1], "rb");
+  if (in == 0)
+    {
+      std::cerr << "cannot open " << argv[1] << std::endl;
+      return 1;
+    }
+  AnimFileHeader header;
+  if (std::fread (&header, sizeof (header), 1, in) != 1
+      || std::memcmp (header.magic, ANIM_BINARY_MAGIC, sizeof (header.magic)) != 0
+      || header.version != ANIM_BINARY_VERSION)
+    {
+      std::cerr << argv[1] << " is not an AnimRecorder file" << std::endl;
+      return 1;
+    }
+  FILE *out = std::fopen (argv[2], "w");
+  if (out == 0)
+    {
+      std::cerr << "cannot open " << argv[2] << std::endl;
+      return 1;
+    }
+  setvbuf (in, 0, _IOFBF, 1 << 20);
+  setvbuf (out, 0, _IOFBF, 1 << 20);
+
+  struct Transmission
+  {
+    uint32_t node;
+    double time;
+  };
+  std::unordered_map<uint64_t, Transmission> transmissions;
+  std::deque<uint64_t> order;   ///< uids in transmissions, oldest first
+
+  std::fprintf (out, "<anim ver=\"netanim-3.108\" filetype=\"animation\" >\n");
+  AnimRecord r;
+  uint64_t records = 0;
+  while (std::fread (&r, sizeof (r), 1, in) == 1)
+    {
+      ++records;
+      switch (r.type)
+        {
+        case ANIM_NODE:
+          std::fprintf (out, "<node id=\"%u\" sysId=\"0\" locX=\"%g\" locY=\"%g\" />\n",
+                        r.node, r.position.x, r.position.y);
+          break;
+        case ANIM_POSITION:
+          std::fprintf (out, "<nu p=\"p\" t=\"%.9g\" id=\"%u\" x=\"%g\" y=\"%g\" />\n",
+                        r.time, r.node, r.position.x, r.position.y);
+          break;
+        case ANIM_TX:
+          {
+            Transmission tx = { r.node, r.time };
+            std::pair<std::unordered_map<uint64_t, Transmission>::iterator, bool> res =
+              transmissions.insert (std::make_pair (r.packet.uid, tx));
+            if (!res.second)
+              {
+                res.first->second = tx;
+                break;
+              }
+            order.push_back (r.packet.uid);
+            if (order.size () > ANIM_MAX_SAMPLED)
+              {
+                transmissions.erase (order.front ());
+                order.pop_front ();
+              }
+          }
+          break;
+        case ANIM_RX:
+          {
+            std::unordered_map<uint64_t, Transmission>::const_iterator tx = transmissions.find (r.packet.uid);
+            if (tx == transmissions.end () || tx->second.node == r.node)
+              {
+                break;
+              }
+            std::fprintf (out, "<p fId=\"%u\" fbTx=\"%.9g\" lbTx=\"%.9g\" tId=\"%u\" fbRx=\"%.9g\" lbRx=\"%.9g\" />\n",
+                          tx->second.node, tx->second.time, tx->second.time, r.node, r.time, r.time);
+          }
+          break;
+        default:
+          std::cerr << "unknown record type " << uint32_t (r.type) << " after " << records << " records" << std::endl;
+          return 1;
+        }
+    }
+  std::fprintf (out, "</anim>\n");
+  std::fclose (in);
+  std::fclose (out);
+  std::cout << records << " records, " << header.nodeCount << " nodes" << std::endl;
+  return 0;
+}
@@ -0,0 +1,266 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Low-overhead alternative to AnimationInterface: AnimRecorder writes
+// node positions and sampled packets as fixed-size binary records, and
+// scratch/anim-bin2xml turns the file into NetAnim XML offline.
+//
+// File layout (host byte order): AnimFileHeader followed by AnimRecord
+// until the end of the file, in simulation time order.
+
+#ifndef ANIM_BINARY_H
+#define ANIM_BINARY_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/wifi-net-device.h"
+#include "ns3/wifi-phy.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+static const char ANIM_BINARY_MAGIC[8] = { 'N', 'S', '3', 'A', 'N', 'I', 'M', 0 };
+static const uint32_t ANIM_BINARY_VERSION = 1;
+/// Sampled uids remembered for their receptions, by the recorder and the converter
+static const uint32_t ANIM_MAX_SAMPLED = 1 << 16;
+
+struct AnimFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t nodeCount;
+};
+
+enum AnimRecordType
+{
+  ANIM_NODE = 0,        //!< initial position of a node
+  ANIM_POSITION = 1,    //!< node moved
+  ANIM_TX = 2,          //!< node started transmitting packet uid
+  ANIM_RX = 3           //!< node finished receiving packet uid
+};
+
+struct AnimPosition
+{
+  double x;
+  double y;
+};
+
+struct AnimPacket
+{
+  uint64_t uid;
+  uint64_t pad;
+};
+
+struct AnimRecord
+{
+  uint8_t type;
+  uint8_t pad[3];
+  uint32_t node;
+  double time;          //!< seconds
+  union
+  {
+    AnimPosition position;      //!< ANIM_NODE and ANIM_POSITION
+    AnimPacket packet;          //!< ANIM_TX and ANIM_RX
+  };
+};
+
+/**
+ * Records what NetAnim needs with a fraction of AnimationInterface's
+ * cost. Positions are polled, but a node's position is only written
+ * once it has moved more than the distance threshold since the last
+ * one written for it. Packets are sampled per transmitting device:
+ * with a sample rate of 0.1 every tenth frame a device sends is
+ * recorded, together with its receptions; the rest cost one counter
+ * update. Construct it after mobility and devices are installed and
+ * delete it after Simulator::Destroy.
+ */
+class AnimRecorder
+{
+public:
+  AnimRecorder (std::string filename, double distanceThreshold, double packetSampleRate,
+                ns3::Time pollInterval = ns3::Seconds (0.25));
+  ~AnimRecorder ();
+
+private:
+  /// What a device's trace sinks are bound to
+  struct Device
+  {
+    AnimRecorder *recorder;
+    uint32_t node;
+    double credit;      //!< accumulated sample rate; a frame is sampled when it reaches 1
+  };
+
+  static void TxBegin (Device *device, ns3::Ptr<const ns3::Packet> packet);
+  static void RxEnd (Device *device, ns3::Ptr<const ns3::Packet> packet);
+
+  void Poll (void);
+  void WritePosition (AnimRecordType type, uint32_t node, ns3::Vector position);
+  void WritePacket (AnimRecordType type, uint32_t node, uint64_t uid);
+
+  FILE *m_file;
+  double m_distanceThreshold;
+  double m_packetSampleRate;
+  ns3::Time m_pollInterval;
+  std::vector<ns3::Vector> m_lastPosition;
+  std::vector<Device *> m_devices;
+  std::unordered_set<uint64_t> m_sampled;
+  std::deque<uint64_t> m_sampledOrder;
+};
+
+inline
+AnimRecorder::AnimRecorder (std::string filename, double distanceThreshold, double packetSampleRate,
+                            ns3::Time pollInterval)
+  : m_file (std::fopen (filename.c_str (), "wb")),
+    m_distanceThreshold (distanceThreshold),
+    m_packetSampleRate (packetSampleRate),
+    m_pollInterval (pollInterval)
+{
+  using namespace ns3;
+  if (m_file == 0)
+    {
+      NS_FATAL_ERROR ("Cannot open " << filename);
+    }
+  setvbuf (m_file, 0, _IOFBF, 1 << 20);
+
+  AnimFileHeader header;
+  std::memset (&header, 0, sizeof (header));
+  std::memcpy (header.magic, ANIM_BINARY_MAGIC, sizeof (header.magic));
+  header.version = ANIM_BINARY_VERSION;
+  header.nodeCount = NodeList::GetNNodes ();
+  std::fwrite (&header, sizeof (header), 1, m_file);
+
+  for (NodeList::Iterator i = NodeList::Begin (); i != NodeList::End (); ++i)
+    {
+      Ptr<Node> node = *i;
+      Ptr<MobilityModel> mobility = node->GetObject<MobilityModel> ();
+      Vector position = mobility ? mobility->GetPosition () : Vector ();
+      m_lastPosition.push_back (position);
+      WritePosition (ANIM_NODE, node->GetId (), position);
+
+      for (uint32_t d = 0; d < node->GetNDevices (); ++d)
+        {
+          Device *device = new Device;
+          device->recorder = this;
+          device->node = node->GetId ();
+          device->credit = 0;
+          m_devices.push_back (device);
+          // PHY traces carry the frame as it goes on and comes off the medium
+          Ptr<WifiNetDevice> wifi = DynamicCast<WifiNetDevice> (node->GetDevice (d));
+          Ptr<Object> phy = wifi ? Ptr<Object> (wifi->GetPhy ()) : Ptr<Object> (node->GetDevice (d));
+          phy->TraceConnectWithoutContext ("PhyTxBegin", MakeBoundCallback (&AnimRecorder::TxBegin, device));
+          phy->TraceConnectWithoutContext ("PhyRxEnd", MakeBoundCallback (&AnimRecorder::RxEnd, device));
+        }
+    }
+  Simulator::Schedule (m_pollInterval, &AnimRecorder::Poll, this);
+}
+
+inline
+AnimRecorder::~AnimRecorder ()
+{
+  std::fclose (m_file);
+  for (uint32_t i = 0; i < m_devices.size (); ++i)
+    {
+      delete m_devices[i];
+    }
+}
+
+inline void
+AnimRecorder::Poll (void)
+{
+  using namespace ns3;
+  for (uint32_t i = 0; i < m_lastPosition.size (); ++i)
+    {
+      Ptr<MobilityModel> mobility = NodeList::GetNode (i)->GetObject<MobilityModel> ();
+      if (!mobility)
+        {
+          continue;
+        }
+      Vector position = mobility->GetPosition ();
+      if (CalculateDistance (position, m_lastPosition[i]) > m_distanceThreshold)
+        {
+          m_lastPosition[i] = position;
+          WritePosition (ANIM_POSITION, i, position);
+        }
+    }
+  Simulator::Schedule (m_pollInterval, &AnimRecorder::Poll, this);
+}
+
+inline void
+AnimRecorder::TxBegin (Device *device, ns3::Ptr<const ns3::Packet> packet)
+{
+  device->credit += device->recorder->m_packetSampleRate;
+  if (device->credit < 1)
+    {
+      return;
+    }
+  device->credit -= 1;
+
+  AnimRecorder *recorder = device->recorder;
+  uint64_t uid = packet->GetUid ();
+  if (recorder->m_sampled.insert (uid).second)
+    {
+      recorder->m_sampledOrder.push_back (uid);
+      if (recorder->m_sampledOrder.size () > ANIM_MAX_SAMPLED)
+        {
+          recorder->m_sampled.erase (recorder->m_sampledOrder.front ());
+          recorder->m_sampledOrder.pop_front ();
+        }
+    }
+  recorder->WritePacket (ANIM_TX, device->node, uid);
+}
+
+inline void
+AnimRecorder::RxEnd (Device *device, ns3::Ptr<const ns3::Packet> packet)
+{
+  uint64_t uid = packet->GetUid ();
+  if (device->recorder->m_sampled.count (uid))
+    {
+      device->recorder->WritePacket (ANIM_RX, device->node, uid);
+    }
+}
+
+inline void
+AnimRecorder::WritePosition (AnimRecordType type, uint32_t node, ns3::Vector position)
+{
+  AnimRecord r;
+  std::memset (&r, 0, sizeof (r));
+  r.type = type;
+  r.node = node;
+  r.time = ns3::Simulator::Now ().GetSeconds ();
+  r.position.x = position.x;
+  r.position.y = position.y;
+  std::fwrite (&r, sizeof (r), 1, m_file);
+}
+
+inline void
+AnimRecorder::WritePacket (AnimRecordType type, uint32_t node, uint64_t uid)
+{
+  AnimRecord r;
+  std::memset (&r, 0, sizeof (r));
+  r.type = type;
+  r.node = node;
+  r.time = ns3::Simulator::Now ().GetSeconds ();
+  r.packet.uid = uid;
+  std::fwrite (&r, sizeof (r), 1, m_file);
+}
+
+#endif /* ANIM_BINARY_H */
@@ -12,20 +12,618 @@
 #include "ns3/on-off-helper.h"
 #include "ns3/propagation-loss-model.h"
 #include "ns3/propagation-delay-model.h"
+#include "anim-binary.h"
+#include "cached-propagation-loss-model.h"
+#include "child-processes.h"
+#include "event-profiler.h"
+#include "live-stats.h"
+#include "table-error-rate-model.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
 
 
 using namespace ns3;
 using namespace std;
 
-int main (int argc, char **argv)
+/**
+ * \brief Log-bucketed histogram in the style of HdrHistogram.
+ *
+ * Values below 2^SUB_BITS are counted exactly; above that every power
+ * of two is split into 2^(SUB_BITS - 1) equal buckets, so a percentile
+ * is off by at most 2^(1 - SUB_BITS) (about 3%) of its value at any
+ * magnitude, up to 2^40 (about 18 minutes in nanoseconds). The counters
+ * are a fixed array of under 5 KB: histograms of different flows or
+ * runs merge by adding them and can be sent through a pipe as they are.
+ */
+class LogHistogram
 {
+public:
+  LogHistogram ()
+    : m_count (0),
+      m_max (0)
+  {
+    std::fill (m_counts, m_counts + N_BUCKETS, 0);
+  }
+  void Add (uint64_t value)
+  {
+    ++m_counts[Index (value)];
+    ++m_count;
+    m_max = std::max (m_max, value);
+  }
+  void Merge (LogHistogram const &other)
+  {
+    for (uint32_t i = 0; i < N_BUCKETS; ++i)
+      {
+        m_counts[i] += other.m_counts[i];
+      }
+    m_count += other.m_count;
+    m_max = std::max (m_max, other.m_max);
+  }
+  uint64_t GetCount (void) const
+  {
+    return m_count;
+  }
+  /// \return the highest value of the bucket holding the q quantile (0 if empty)
+  uint64_t GetPercentile (double q) const
+  {
+    uint64_t rank = std::max<uint64_t> (1, std::ceil (q * m_count));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < N_BUCKETS; ++i)
+      {
+        seen += m_counts[i];
+        if (seen >= rank)
+          {
+            return std::min (HighestValue (i), m_max);
+          }
+      }
+    return m_max;
+  }
 
-Config::SetDefault  ("ns3::OnOffApplication::PacketSize",StringValue ("64"));
-Config::SetDefault ("ns3::OnOffApplication::DataRate",StringValue ("1024bps"));
+private:
+  static const uint32_t SUB_BITS = 6;
+  static const uint32_t HALF = 1 << (SUB_BITS - 1);
+  static const uint32_t MAX_SHIFT = 40 - SUB_BITS;
+  static const uint32_t N_BUCKETS = (MAX_SHIFT + 2) * HALF;
 
-  //Set Non-unicastMode rate to unicast mode
-Config::SetDefault ("ns3::WifiRemoteStationManager::NonUnicastMode",StringValue("DsssRate2Mbps"));
+  static uint32_t Index (uint64_t value)
+  {
+    if (value < 2 * HALF)
+      {
+        return value;
+      }
+    uint32_t shift = 63 - __builtin_clzll (value) - SUB_BITS + 1;
+    if (shift > MAX_SHIFT)
+      {
+        return N_BUCKETS - 1;
+      }
+    return shift * HALF + (value >> shift);
+  }
+  static uint64_t HighestValue (uint32_t index)
+  {
+    if (index < 2 * HALF)
+      {
+        return index;
+      }
+    uint32_t shift = index / HALF - 1;
+    uint64_t sub = index - shift * HALF;
+    return ((sub + 1) << shift) - 1;
+  }
+
+  uint64_t m_count;
+  uint64_t m_max;
+  uint32_t m_counts[N_BUCKETS];
+};
+
+/// Delay (ns), jitter (ns) and packet size (bytes) histograms
+struct LatencyHistograms
+{
+  LogHistogram delay;
+  LogHistogram jitter;
+  LogHistogram size;
+
+  void Merge (LatencyHistograms const &other)
+  {
+    delay.Merge (other.delay);
+    jitter.Merge (other.jitter);
+    size.Merge (other.size);
+  }
+};
+
+static void
+PrintPercentiles (std::string name, LogHistogram const &h, double scale, std::string unit)
+{
+  cout << "  " << name << " p50/p99/p99.9: "
+       << h.GetPercentile (0.5) * scale << " / " << h.GetPercentile (0.99) * scale << " / "
+       << h.GetPercentile (0.999) * scale << " " << unit << "\n";
+}
+
+static void
+PrintLatencyHistograms (LatencyHistograms const &h)
+{
+  PrintPercentiles ("Delay ", h.delay, 1e-6, "ms");
+  PrintPercentiles ("Jitter", h.jitter, 1e-6, "ms");
+  PrintPercentiles ("Size  ", h.size, 1, "bytes");
+}
+
+/// Time a packet left its source, carried to the destination
+class SendTimeTag : public Tag
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::SendTimeTag")
+      .SetParent<Tag> ()
+      .AddConstructor<SendTimeTag> ()
+    ;
+    return tid;
+  }
+  virtual TypeId GetInstanceTypeId (void) const
+  {
+    return GetTypeId ();
+  }
+  virtual uint32_t GetSerializedSize (void) const
+  {
+    return 8;
+  }
+  virtual void Serialize (TagBuffer i) const
+  {
+    i.WriteU64 (m_time);
+  }
+  virtual void Deserialize (TagBuffer i)
+  {
+    m_time = i.ReadU64 ();
+  }
+  virtual void Print (std::ostream &os) const
+  {
+    os << "t=" << m_time;
+  }
+  uint64_t m_time; ///< nanoseconds
+};
+
+NS_OBJECT_ENSURE_REGISTERED (SendTimeTag);
+
+/**
+ * Per flow LatencyHistograms, collected next to FlowMonitor, whose own
+ * fixed-width histograms cannot be swapped out. Packets are stamped
+ * with a SendTimeTag when their source sends them (Ipv4L3Protocol
+ * SendOutgoing) and measured when they are delivered locally
+ * (LocalDeliver); jitter is the difference between consecutive delays
+ * of a flow, as in FlowMonitor, and the size is that of the IP packet
+ * as sent.
+ */
+class LatencyMonitor
+{
+public:
+  LatencyMonitor (NodeContainer nodes)
+  {
+    for (uint32_t i = 0; i < nodes.GetN (); ++i)
+      {
+        Ptr<Ipv4L3Protocol> ipv4 = nodes.Get (i)->GetObject<Ipv4L3Protocol> ();
+        ipv4->TraceConnectWithoutContext ("SendOutgoing", MakeCallback (&LatencyMonitor::SendOutgoing, this));
+        ipv4->TraceConnectWithoutContext ("LocalDeliver", MakeCallback (&LatencyMonitor::LocalDeliver, this));
+      }
+  }
+  LatencyHistograms GetTotal (void) const
+  {
+    LatencyHistograms total;
+    for (std::map<Key, Flow>::const_iterator i = m_flows.begin (); i != m_flows.end (); ++i)
+      {
+        total.Merge (i->second.histograms);
+      }
+    return total;
+  }
+  void Print (void) const
+  {
+    for (std::map<Key, Flow>::const_iterator i = m_flows.begin (); i != m_flows.end (); ++i)
+      {
+        cout << "Flow " << Ipv4Address (i->first.source) << ":" << i->first.sourcePort << " -> "
+             << Ipv4Address (i->first.destination) << ":" << i->first.destinationPort
+             << " proto " << uint32_t (i->first.protocol) << "\n";
+        PrintLatencyHistograms (i->second.histograms);
+      }
+  }
+
+private:
+  struct Key
+  {
+    uint32_t source;
+    uint32_t destination;
+    uint8_t protocol;
+    uint16_t sourcePort;
+    uint16_t destinationPort;
+
+    bool operator < (Key const &o) const
+    {
+      if (source != o.source)
+        {
+          return source < o.source;
+        }
+      if (destination != o.destination)
+        {
+          return destination < o.destination;
+        }
+      if (protocol != o.protocol)
+        {
+          return protocol < o.protocol;
+        }
+      if (sourcePort != o.sourcePort)
+        {
+          return sourcePort < o.sourcePort;
+        }
+      return destinationPort < o.destinationPort;
+    }
+  };
+  struct Flow
+  {
+    Flow ()
+      : lastDelay (-1)
+    {
+    }
+    LatencyHistograms histograms;
+    int64_t lastDelay; ///< ns, -1 before the first packet
+  };
+
+  static Key GetKey (Ipv4Header const &header, Ptr<const Packet> packet)
+  {
+    Key key = { header.GetSource ().Get (), header.GetDestination ().Get (), header.GetProtocol (), 0, 0 };
+    if (header.GetFragmentOffset () == 0 && key.protocol == UdpL4Protocol::PROT_NUMBER)
+      {
+        UdpHeader udp;
+        packet->PeekHeader (udp);
+        key.sourcePort = udp.GetSourcePort ();
+        key.destinationPort = udp.GetDestinationPort ();
+      }
+    else if (header.GetFragmentOffset () == 0 && key.protocol == TcpL4Protocol::PROT_NUMBER)
+      {
+        TcpHeader tcp;
+        packet->PeekHeader (tcp);
+        key.sourcePort = tcp.GetSourcePort ();
+        key.destinationPort = tcp.GetDestinationPort ();
+      }
+    return key;
+  }
+
+  void SendOutgoing (Ipv4Header const &header, Ptr<const Packet> packet, uint32_t interface)
+  {
+    SendTimeTag tag;
+    if (packet->PeekPacketTag (tag))
+      {
+        return;
+      }
+    tag.m_time = Simulator::Now ().GetNanoSeconds ();
+    ConstCast<Packet> (packet)->AddPacketTag (tag);
+    m_flows[GetKey (header, packet)].histograms.size.Add (packet->GetSize () + header.GetSerializedSize ());
+  }
+
+  void LocalDeliver (Ipv4Header const &header, Ptr<const Packet> packet, uint32_t interface)
+  {
+    SendTimeTag tag;
+    if (!packet->PeekPacketTag (tag))
+      {
+        return;
+      }
+    Flow &flow = m_flows[GetKey (header, packet)];
+    int64_t delay = Simulator::Now ().GetNanoSeconds () - tag.m_time;
+    flow.histograms.delay.Add (delay);
+    if (flow.lastDelay >= 0)
+      {
+        flow.histograms.jitter.Add (std::abs (delay - flow.lastDelay));
+      }
+    flow.lastDelay = delay;
+  }
+
+  std::map<Key, Flow> m_flows;
+};
+
+/**
+ * \brief Publishes the progress of the running simulation to a live
+ * stats segment (see live-stats.h) for scratch/stats-watch.
+ *
+ * The snapshots are taken on the simulation thread between two events,
+ * by the LiveStatsScheduler that Start wraps around the scheduler in
+ * use, whenever at least the publishing interval of wall-clock time
+ * has passed; the check costs a clock read every CHECK_EVERY events.
+ * The event loop is never paused for a reader.
+ */
+class LiveStatsPublisher : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+  LiveStatsPublisher ();
+  virtual ~LiveStatsPublisher ();
+
+  /**
+   * Create the segment and wrap the current SchedulerType in a
+   * LiveStatsScheduler that reports to this publisher.
+   *
+   * \param name shm_open name of the segment; '/' is prepended if missing
+   * \param interval wall-clock seconds between snapshots
+   */
+  void Start (std::string name, double interval, Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier);
+  /// Publish the final snapshot, flagged finished, and remove the segment
+  void Finish (void);
+  /// Called by LiveStatsScheduler when it takes an event off the queue
+  void EventRemoved (uint64_t ts, uint64_t queueSize);
+
+  /// Events between two reads of the wall clock
+  static const uint32_t CHECK_EVERY = 4096;
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  void Publish (bool finished);
+
+  LiveStatsWriter m_writer;
+  double m_interval;
+  Ptr<FlowMonitor> m_monitor;
+  Ptr<Ipv4FlowClassifier> m_classifier;
+  Clock::time_point m_start;
+  Clock::time_point m_lastPublished;
+  uint64_t m_lastEvents;
+  uint64_t m_ts;
+  uint64_t m_events;
+  uint64_t m_queueSize;
+};
+
+/**
+ * \brief Forwards to another scheduler and keeps the number of queued
+ * events for a LiveStatsPublisher, which it calls on every RemoveNext.
+ */
+class LiveStatsScheduler : public Scheduler
+{
+public:
+  static TypeId GetTypeId (void);
+  LiveStatsScheduler ();
+  virtual ~LiveStatsScheduler ();
+
+  virtual void Insert (const Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Event PeekNext (void) const;
+  virtual Event RemoveNext (void);
+  virtual void Remove (const Event &ev);
+
+private:
+  void SetScheduler (TypeId tid);
+
+  Ptr<Scheduler> m_scheduler;
+  Ptr<LiveStatsPublisher> m_publisher;
+  uint64_t m_size;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (LiveStatsPublisher);
+
+TypeId
+LiveStatsPublisher::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LiveStatsPublisher")
+    .SetParent<Object> ()
+    .AddConstructor<LiveStatsPublisher> ()
+  ;
+  return tid;
+}
+
+LiveStatsPublisher::LiveStatsPublisher ()
+  : m_interval (1.0),
+    m_lastEvents (0),
+    m_ts (0),
+    m_events (0),
+    m_queueSize (0)
+{
+}
+
+LiveStatsPublisher::~LiveStatsPublisher ()
+{
+}
+
+void
+LiveStatsPublisher::Start (std::string name, double interval, Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier)
+{
+  if (name.empty () || name[0] != '/')
+    {
+      name = "/" + name;
+    }
+  if (!m_writer.Open (name))
+    {
+      NS_FATAL_ERROR ("Cannot create shared memory segment " << name << ": " << strerror (errno));
+    }
+  m_interval = interval;
+  m_monitor = monitor;
+  m_classifier = classifier;
+  m_start = m_lastPublished = Clock::now ();
+
+  TypeIdValue current;
+  GlobalValue::GetValueByName ("SchedulerType", current);
+  ObjectFactory factory;
+  factory.SetTypeId (LiveStatsScheduler::GetTypeId ());
+  factory.Set ("Scheduler", current);
+  factory.Set ("Publisher", PointerValue (this));
+  Simulator::SetScheduler (factory);
+  Publish (false);
+}
+
+void
+LiveStatsPublisher::Finish (void)
+{
+  Publish (true);
+  m_writer.Close ();
+}
+
+void
+LiveStatsPublisher::EventRemoved (uint64_t ts, uint64_t queueSize)
+{
+  m_ts = ts;
+  m_queueSize = queueSize;
+  if (++m_events % CHECK_EVERY == 0
+      && std::chrono::duration<double> (Clock::now () - m_lastPublished).count () >= m_interval)
+    {
+      Publish (false);
+    }
+}
+
+void
+LiveStatsPublisher::Publish (bool finished)
+{
+  Clock::time_point now = Clock::now ();
+  double elapsed = std::chrono::duration<double> (now - m_lastPublished).count ();
+
+  LiveStatsSnapshot s;
+  std::memset (&s, 0, sizeof (s));
+  s.simTime = TimeStep (m_ts).GetNanoSeconds ();
+  s.wallTime = std::chrono::duration<double> (now - m_start).count ();
+  s.events = m_events;
+  s.eventsPerSecond = elapsed > 0 ? (m_events - m_lastEvents) / elapsed : 0;
+  s.queueSize = m_queueSize;
+  s.residentBytes = GetResidentBytes ();
+  s.finished = finished;
+
+  const FlowMonitor::FlowStatsContainer &stats = m_monitor->GetFlowStats ();
+  s.totalFlows = stats.size ();
+  for (FlowMonitor::FlowStatsContainerCI i = stats.begin (); i != stats.end () && s.flowCount < LIVE_STATS_MAX_FLOWS; ++i)
+    {
+      Ipv4FlowClassifier::FiveTuple t = m_classifier->FindFlow (i->first);
+      LiveStatsFlow &f = s.flows[s.flowCount++];
+      f.source = t.sourceAddress.Get ();
+      f.destination = t.destinationAddress.Get ();
+      f.sourcePort = t.sourcePort;
+      f.destinationPort = t.destinationPort;
+      f.protocol = t.protocol;
+      f.txPackets = i->second.txPackets;
+      f.rxPackets = i->second.rxPackets;
+      f.txBytes = i->second.txBytes;
+      f.rxBytes = i->second.rxBytes;
+    }
+  m_writer.Publish (s);
+  m_lastPublished = now;
+  m_lastEvents = m_events;
+}
+
+NS_OBJECT_ENSURE_REGISTERED (LiveStatsScheduler);
+
+TypeId
+LiveStatsScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LiveStatsScheduler")
+    .SetParent<Scheduler> ()
+    .AddConstructor<LiveStatsScheduler> ()
+    .AddAttribute ("Scheduler", "The scheduler that holds the events.",
+                   TypeIdValue (MapScheduler::GetTypeId ()),
+                   MakeTypeIdAccessor (&LiveStatsScheduler::SetScheduler),
+                   MakeTypeIdChecker ())
+    .AddAttribute ("Publisher", "The publisher told about every event taken off the queue.",
+                   PointerValue (),
+                   MakePointerAccessor (&LiveStatsScheduler::m_publisher),
+                   MakePointerChecker<LiveStatsPublisher> ())
+  ;
+  return tid;
+}
+
+LiveStatsScheduler::LiveStatsScheduler ()
+  : m_size (0)
+{
+}
+
+LiveStatsScheduler::~LiveStatsScheduler ()
+{
+}
+
+void
+LiveStatsScheduler::SetScheduler (TypeId tid)
+{
+  ObjectFactory factory;
+  factory.SetTypeId (tid);
+  m_scheduler = factory.Create<Scheduler> ();
+}
+
+void
+LiveStatsScheduler::Insert (const Event &ev)
+{
+  ++m_size;
+  m_scheduler->Insert (ev);
+}
+
+bool
+LiveStatsScheduler::IsEmpty (void) const
+{
+  return m_scheduler->IsEmpty ();
+}
+
+Scheduler::Event
+LiveStatsScheduler::PeekNext (void) const
+{
+  return m_scheduler->PeekNext ();
+}
+
+Scheduler::Event
+LiveStatsScheduler::RemoveNext (void)
+{
+  Event ev = m_scheduler->RemoveNext ();
+  --m_size;
+  if (m_publisher)
+    {
+      m_publisher->EventRemoved (ev.key.m_ts, m_size);
+    }
+  return ev;
+}
+
+void
+LiveStatsScheduler::Remove (const Event &ev)
+{
+  --m_size;
+  m_scheduler->Remove (ev);
+}
 
+/// Aggregate throughput, loss and latency histograms of one run over all flows
+struct ReplicationResult
+{
+  double throughput; ///< Kbps
+  double loss;       ///< percent of transmitted packets
+  LatencyHistograms latency; ///< empty unless the run collected them
+};
+
+/// How the NetAnim trace of a run that is not quiet is written
+struct AnimOptions
+{
+  AnimOptions ()
+    : format ("xml"),
+      moveThreshold (1.0),
+      packetSample (1.0)
+  {
+  }
+  std::string format;   ///< xml (AnimationInterface, aodv.xml) or binary (AnimRecorder, aodv.anim)
+  double moveThreshold; ///< meters a node moves before its position is written again
+  double packetSample;  ///< fraction of each device's frames that is recorded
+};
+
+/**
+ * Build and run the scenario once.
+ *
+ * In quiet mode neither the NetAnim trace nor the per flow statistics
+ * are written, only the returned totals are collected. With cacheLoss
+ * the Friis loss is memoized per link by CachedPropagationLossModel.
+ * With tableErrorRate the PHYs look chunk success rates up in the
+ * tables of TableDsssErrorRateModel. With latencyHistograms a
+ * LatencyMonitor is installed; its per flow percentiles are printed
+ * unless quiet, and its merged histograms are returned. Unless
+ * liveStats is empty, progress is published to the shared memory
+ * segment of that name while the simulation runs.
+ */
+static ReplicationResult
+RunScenario (bool quiet, bool cacheLoss, bool tableErrorRate, bool latencyHistograms,
+             std::string const &liveStats, AnimOptions const &animOptions = AnimOptions ())
+{
   NodeContainer nodes;
   nodes.Create (20);
 
@@ -54,8 +652,20 @@ Config::SetDefault ("ns3::WifiRemoteStationManager::NonUnicastMode",StringValue(
   YansWifiPhyHelper wifiPhy =  YansWifiPhyHelper::Default ();
   YansWifiChannelHelper wifiChannel;
   wifiChannel.SetPropagationDelay ("ns3::ConstantSpeedPropagationDelayModel");
-  wifiChannel.AddPropagationLoss ("ns3::FriisPropagationLossModel");
+  if (cacheLoss)
+    {
+      wifiChannel.AddPropagationLoss ("ns3::CachedPropagationLossModel",
+                                      "Model", PointerValue (CreateObject<FriisPropagationLossModel> ()));
+    }
+  else
+    {
+      wifiChannel.AddPropagationLoss ("ns3::FriisPropagationLossModel");
+    }
   wifiPhy.SetChannel (wifiChannel.Create ());
+  if (tableErrorRate)
+    {
+      wifiPhy.SetErrorRateModel ("ns3::TableDsssErrorRateModel");
+    }
 
   // Add a mac 
   WifiMacHelper wifiMac;
@@ -106,20 +716,50 @@ Config::SetDefault ("ns3::WifiRemoteStationManager::NonUnicastMode",StringValue(
 
   FlowMonitorHelper flowmon;
   Ptr<FlowMonitor> monitor = flowmon.InstallAll ();
+  LatencyMonitor *latency = latencyHistograms ? new LatencyMonitor (nodes) : 0;
+  Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (flowmon.GetClassifier ());
+  Ptr<LiveStatsPublisher> publisher;
+  if (!liveStats.empty ())
+    {
+      publisher = CreateObject<LiveStatsPublisher> ();
+      publisher->Start (liveStats, 1.0, monitor, classifier);
+    }
 
   Simulator::Stop (Seconds (TotalTime));
 
-  AnimationInterface anim("aodv.xml");
+  AnimationInterface *anim = 0;
+  AnimRecorder *animRecorder = 0;
+  if (!quiet && animOptions.format == "binary")
+    {
+      animRecorder = new AnimRecorder ("aodv.anim", animOptions.moveThreshold, animOptions.packetSample);
+    }
+  else if (!quiet)
+    {
+      anim = new AnimationInterface ("aodv.xml");
+    }
 
-  Simulator::Run ();
+  TimedSimulatorRun ();
+  if (publisher)
+    {
+      publisher->Finish ();
+    }
 
   monitor->CheckForLostPackets ();
-  Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (flowmon.GetClassifier ());
   FlowMonitor::FlowStatsContainer stats = monitor->GetFlowStats ();
+  uint64_t txPackets = 0;
+  uint64_t rxPackets = 0;
+  uint64_t rxBytes = 0;
   for (map<FlowId, FlowMonitor::FlowStats>::const_iterator i = stats.begin (); i != stats.end (); ++i)
     {
       if (i->first)
         {
+          txPackets += i->second.txPackets;
+          rxPackets += i->second.rxPackets;
+          rxBytes += i->second.rxBytes;
+          if (quiet)
+            {
+              continue;
+            }
           Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow (i->first);
           cout << "Flow " << i->first << " (" << t.sourceAddress << " -> " << t.destinationAddress << ")\n";
           cout << "  Tx Packets: " << i->second.txPackets << "\n";
@@ -133,7 +773,249 @@ Config::SetDefault ("ns3::WifiRemoteStationManager::NonUnicastMode",StringValue(
         }
     }
 
-  
+
+  ReplicationResult result;
+  result.throughput = rxBytes * 8.0 / 9.0 / 1000;
+  result.loss = txPackets ? (txPackets - rxPackets) * 100.0 / txPackets : 0;
+  if (latency)
+    {
+      result.latency = latency->GetTotal ();
+      if (!quiet)
+        {
+          latency->Print ();
+        }
+    }
+
   Simulator::Destroy ();
+  delete anim;
+  delete animRecorder;
+  delete latency;
+  return result;
+}
+
+/// Running mean and variance of a sample (Welford's algorithm)
+class OnlineStat
+{
+public:
+  OnlineStat ()
+    : m_n (0),
+      m_mean (0),
+      m_m2 (0)
+  {
+  }
+  void Add (double x)
+  {
+    ++m_n;
+    double delta = x - m_mean;
+    m_mean += delta / m_n;
+    m_m2 += delta * (x - m_mean);
+  }
+  uint32_t GetCount (void) const
+  {
+    return m_n;
+  }
+  double GetMean (void) const
+  {
+    return m_mean;
+  }
+  /// Half-width of the 95% confidence interval of the mean
+  double GetHalfWidth (void) const
+  {
+    // Two-sided 95% Student t quantiles for 1..30 degrees of freedom
+    static const double t[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    if (m_n < 2)
+      {
+        return HUGE_VAL;
+      }
+    uint32_t df = m_n - 1;
+    double q = df <= 30 ? t[df - 1] : (df <= 60 ? 2.000 : (df <= 120 ? 1.980 : 1.960));
+    return q * std::sqrt (m_m2 / df / m_n);
+  }
+private:
+  uint32_t m_n;
+  double m_mean;
+  double m_m2;
+};
+
+static void
+PrintEstimate (OnlineStat const &stat)
+{
+  cout << setw (10) << stat.GetMean ();
+  if (stat.GetCount () < 2)
+    {
+      cout << setw (10) << "-";
+    }
+  else
+    {
+      cout << setw (10) << stat.GetHalfWidth ();
+    }
+}
+
+/**
+ * \return the shm_open name of the live stats segment the worker of
+ * RngRun run publishes to
+ */
+static std::string
+ReplicationSegment (std::string const &liveStats, uint32_t run)
+{
+  std::ostringstream segment;
+  segment << (liveStats[0] == '/' ? "" : "/") << liveStats << "-" << run;
+  return segment.str ();
+}
+
+/**
+ * Run up to maxReplications replications with consecutive RngRun
+ * values, starting at the current one, on at most nWorkers concurrent
+ * worker processes.
+ *
+ * Results are folded into the running estimates in run order rather
+ * than in completion order, so where the CI targets are met does not
+ * depend on how the workers happened to be scheduled. Once they are
+ * met the remaining workers are killed. A target of 0 is not checked;
+ * without any target every replication is run. cacheLoss and
+ * tableErrorRate are passed on to RunScenario. With latencyHistograms
+ * the latency histograms of the folded replications are merged and
+ * their percentiles printed at the end. Unless liveStats is empty,
+ * each worker publishes its progress to the segment liveStats-<RngRun>,
+ * which is removed here if the worker is killed or aborts, and unless
+ * profile is empty it writes an event profile to profile-<RngRun>.
+ */
+static void
+RunReplications (uint32_t maxReplications, uint32_t minReplications, uint32_t nWorkers,
+                 double throughputCi, double lossCi, bool cacheLoss, bool tableErrorRate,
+                 bool latencyHistograms, std::string const &liveStats, std::string const &profile)
+{
+  uint32_t firstRun = RngSeedManager::GetRun ();
+  map<uint32_t, ReplicationResult> done; // finished, waiting for earlier replications
+  OnlineStat throughput;
+  OnlineStat loss;
+  LatencyHistograms latency;
+  bool converged = false;
+
+  cout << setw (6) << "Run" << setw (10) << "Thr(Kbps)" << setw (10) << "Loss(%)"
+       << setw (10) << "MeanThr" << setw (10) << "+/-" << setw (10) << "MeanLoss" << setw (10) << "+/-"
+       << "\n";
+  RunJobPool<ReplicationResult> (maxReplications, nWorkers,
+    [&] (uint32_t replication)
+    {
+      RngSeedManager::SetRun (firstRun + replication);
+      std::string segment;
+      if (!liveStats.empty ())
+        {
+          segment = ReplicationSegment (liveStats, firstRun + replication);
+        }
+      if (!profile.empty ())
+        {
+          std::ostringstream output;
+          output << profile << "-" << firstRun + replication;
+          EnableEventProfiling (output.str ());
+        }
+      return RunScenario (true, cacheLoss, tableErrorRate, latencyHistograms, segment);
+    },
+    [&] (uint32_t replication, ReplicationResult const &r)
+    {
+      done[replication] = r;
+      while (!converged && done.count (throughput.GetCount ()))
+        {
+          uint32_t k = throughput.GetCount ();
+          throughput.Add (done[k].throughput);
+          loss.Add (done[k].loss);
+          latency.Merge (done[k].latency);
+          cout << setw (6) << firstRun + k << setw (10) << done[k].throughput << setw (10) << done[k].loss;
+          PrintEstimate (throughput);
+          PrintEstimate (loss);
+          cout << "\n" << flush;
+          done.erase (k);
+
+          converged = throughput.GetCount () >= minReplications
+            && (throughputCi > 0 || lossCi > 0)
+            && (throughputCi <= 0 || throughput.GetHalfWidth () <= throughputCi)
+            && (lossCi <= 0 || loss.GetHalfWidth () <= lossCi);
+        }
+      return !converged;
+    },
+    [&] (uint32_t replication)
+    {
+      // A killed or aborted worker leaves its segment behind
+      if (!liveStats.empty ())
+        {
+          shm_unlink (ReplicationSegment (liveStats, firstRun + replication).c_str ());
+        }
+    });
+
+  cout << "------------------------------------------------\n";
+  cout << (converged ? "CI target met after " : "CI target not met after ")
+       << throughput.GetCount () << " replications\n";
+  cout << "  Throughput: " << throughput.GetMean () << " +/- " << throughput.GetHalfWidth () << " Kbps\n";
+  cout << "  Packet Loss Ratio: " << loss.GetMean () << " +/- " << loss.GetHalfWidth () << "%\n";
+  if (latencyHistograms)
+    {
+      cout << "Latency over " << latency.delay.GetCount () << " delivered packets\n";
+      PrintLatencyHistograms (latency);
+    }
 }
 
+int main (int argc, char **argv)
+{
+
+Config::SetDefault  ("ns3::OnOffApplication::PacketSize",StringValue ("64"));
+Config::SetDefault ("ns3::OnOffApplication::DataRate",StringValue ("1024bps"));
+
+  //Set Non-unicastMode rate to unicast mode
+Config::SetDefault ("ns3::WifiRemoteStationManager::NonUnicastMode",StringValue("DsssRate2Mbps"));
+
+  uint32_t replications = 0;
+  uint32_t minReplications = 3;
+  uint32_t nWorkers = sysconf (_SC_NPROCESSORS_ONLN);
+  double throughputCi = 0;
+  double lossCi = 0;
+  bool cacheLoss = false;
+  bool tableErrorRate = false;
+  bool benchmark = false;
+  bool latencyHistograms = false;
+  std::string liveStats;
+  std::string profile;
+  AnimOptions animOptions;
+  CommandLine cmd;
+  cmd.AddValue ("animFormat", "NetAnim output: xml (aodv.xml) or binary (aodv.anim, see anim-bin2xml)", animOptions.format);
+  cmd.AddValue ("animMoveThreshold", "Binary NetAnim: meters a node moves before its position is written again", animOptions.moveThreshold);
+  cmd.AddValue ("animPacketSample", "Binary NetAnim: fraction of each device's frames recorded", animOptions.packetSample);
+  cmd.AddValue ("benchmark", "Time the scenario under every event scheduler", benchmark);
+  cmd.AddValue ("cacheLoss", "Memoize the propagation loss per link (see ns3::CachedPropagationLossModel::PositionEpsilon)", cacheLoss);
+  cmd.AddValue ("tableErrorRate", "Look the DSSS/CCK chunk success rates up in precomputed tables (see ns3::TableDsssErrorRateModel)", tableErrorRate);
+  cmd.AddValue ("errorRateCache", "ns3::TableDsssErrorRateModel::CacheFile");
+  cmd.AddValue ("replications", "Run up to this many RngRun replications in parallel (0 = single run)", replications);
+  cmd.AddValue ("minReplications", "Replications to complete before stopping early", minReplications);
+  cmd.AddValue ("latencyHistograms", "Print p50/p99/p99.9 of delay, jitter and packet size from log-bucketed histograms", latencyHistograms);
+  cmd.AddValue ("liveStats", "Publish progress to this shared memory segment while running (see stats-watch); replications add -<RngRun>", liveStats);
+  cmd.AddValue ("profile", "Write the wall time spent per event type to this file and a flamegraph input to FILE.folded; replications add -<RngRun>", profile);
+  cmd.AddValue ("jobs", "Maximum number of concurrent replication workers", nWorkers);
+  cmd.AddValue ("throughputCi", "Stop once the 95% CI half-width of the throughput is below this many Kbps", throughputCi);
+  cmd.AddValue ("lossCi", "Stop once the 95% CI half-width of the packet loss is below this many percent", lossCi);
+  cmd.Parse (argc, argv);
+
+  if (tableErrorRate)
+    {
+      // built once here rather than in every benchmark or replication child
+      CreateObject<TableDsssErrorRateModel> ()->Prepare ();
+    }
+  if (benchmark)
+    {
+      BenchmarkSchedulers (bind (&RunScenario, true, cacheLoss, tableErrorRate, latencyHistograms, std::string (), AnimOptions ()));
+      return 0;
+    }
+  if (replications == 0)
+    {
+      if (!profile.empty ())
+        {
+          EnableEventProfiling (profile);
+        }
+      RunScenario (false, cacheLoss, tableErrorRate, latencyHistograms, liveStats, animOptions);
+      return 0;
+    }
+  RunReplications (replications, max (minReplications, 2u), max (nWorkers, 1u),
+                   throughputCi, lossCi, cacheLoss, tableErrorRate, latencyHistograms, liveStats, profile);
+  return 0;
+}
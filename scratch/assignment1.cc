@@ -22,11 +22,26 @@
 #include "ns3/csma-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/yans-wifi-helper.h"
+#include "ns3/wifi-net-device.h"
+#include "ns3/wifi-phy.h"
 #include "ns3/ssid.h"
 #include "ns3/netanim-module.h"
 #include "ns3/flow-monitor.h"
 #include "ns3/ipv4-flow-classifier.h"
 #include "ns3/flow-monitor-helper.h"
+#include "anim-binary.h"
+#include "async-trace-file.h"
+#include "cached-propagation-loss-model.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <vector>
 
 // Default Network Topology
 //
@@ -42,15 +57,273 @@ using namespace ns3;
 using namespace std;
 NS_LOG_COMPONENT_DEFINE ("third");
 
+/**
+ * Same as YansWifiChannelHelper::Default (), but with cacheLoss the
+ * log-distance loss is memoized per link, so links between the static
+ * AP and nodes that are not moving are computed only once.
+ */
+static YansWifiChannelHelper
+DefaultChannel (bool cacheLoss)
+{
+  if (!cacheLoss)
+    {
+      return YansWifiChannelHelper::Default ();
+    }
+  YansWifiChannelHelper helper;
+  helper.SetPropagationDelay ("ns3::ConstantSpeedPropagationDelayModel");
+  helper.AddPropagationLoss ("ns3::CachedPropagationLossModel",
+                             "Model", PointerValue (CreateObject<LogDistancePropagationLossModel> ()));
+  return helper;
+}
+
+/**
+ * One pcapng file holding the captures of any number of devices, each
+ * as its own interface, written as a single sequential, large-buffered
+ * stream instead of one pcap file per device. Point-to-point devices
+ * are captured as PPP, CSMA devices as Ethernet and wifi devices as
+ * 802.11 with a small radiotap header (flags, rate, channel and, on
+ * reception, signal and noise). Timestamps are in nanoseconds. Any
+ * failed write, including the final flush, is fatal.
+ */
+class PcapngFile
+{
+public:
+  PcapngFile (std::string filename);
+  ~PcapngFile ();
+  /// Add an interface for device and connect its sniffer traces; call before Simulator::Run
+  void AddDevice (Ptr<NetDevice> device);
+
+private:
+  static const uint32_t SNAP_LEN = 65535;
+  static const uint16_t LINKTYPE_ETHERNET = 1;
+  static const uint16_t LINKTYPE_PPP = 9;
+  static const uint16_t LINKTYPE_IEEE802_11_RADIOTAP = 127;
+
+  /// What a sniffer callback is bound to
+  struct Interface
+  {
+    PcapngFile *file;
+    uint32_t id;
+  };
+
+  static void PacketSniffer (Interface *iface, Ptr<const Packet> packet);
+  static void WifiRxSniffer (Interface *iface, Ptr<const Packet> packet, uint16_t channelFreqMhz,
+                             WifiTxVector txVector, MpduInfo aMpdu, SignalNoiseDbm signalNoise);
+  static void WifiTxSniffer (Interface *iface, Ptr<const Packet> packet, uint16_t channelFreqMhz,
+                             WifiTxVector txVector, MpduInfo aMpdu);
+
+  void WriteInterface (uint16_t linkType, std::string name);
+  /// Write an enhanced packet block; the radiotap header, if any, is prepended to packet
+  void WritePacket (uint32_t id, const uint8_t *radiotap, uint32_t radiotapSize, Ptr<const Packet> packet);
+  /// Build the radiotap header into buffer; signalNoise is 0 for transmitted frames
+  static uint32_t Radiotap (uint8_t *buffer, uint16_t channelFreqMhz, WifiTxVector txVector,
+                            const SignalNoiseDbm *signalNoise);
+  /// Write size bytes of data or fail
+  void Put (const void *data, uint32_t size);
+
+  std::string m_filename;       ///< for messages
+  FILE *m_file;
+  std::vector<Interface *> m_interfaces;
+  std::vector<uint8_t> m_buffer;
+};
+
+PcapngFile::PcapngFile (std::string filename)
+  : m_filename (filename),
+    m_file (std::fopen (filename.c_str (), "wb"))
+{
+  if (m_file == 0)
+    {
+      NS_FATAL_ERROR ("Cannot open " << filename << ": " << std::strerror (errno));
+    }
+  setvbuf (m_file, 0, _IOFBF, 8 << 20);
+
+  // Section header block, version 1.0, section length unknown
+  uint32_t header[] = { 0x0a0d0d0a, 28, 0x1a2b3c4d };
+  uint16_t version[] = { 1, 0 };
+  int64_t sectionLength = -1;
+  uint32_t length = 28;
+  Put (header, sizeof (header));
+  Put (version, sizeof (version));
+  Put (&sectionLength, sizeof (sectionLength));
+  Put (&length, sizeof (length));
+}
+
+PcapngFile::~PcapngFile ()
+{
+  if (std::fflush (m_file) != 0 || std::ferror (m_file))
+    {
+      NS_FATAL_ERROR ("Cannot write " << m_filename << ": " << std::strerror (errno));
+    }
+  if (std::fclose (m_file) != 0)
+    {
+      NS_FATAL_ERROR ("Cannot write " << m_filename << ": " << std::strerror (errno));
+    }
+  for (uint32_t i = 0; i < m_interfaces.size (); ++i)
+    {
+      delete m_interfaces[i];
+    }
+}
+
+void
+PcapngFile::AddDevice (Ptr<NetDevice> device)
+{
+  Interface *iface = new Interface;
+  iface->file = this;
+  iface->id = m_interfaces.size ();
+  m_interfaces.push_back (iface);
+
+  std::ostringstream name;
+  name << device->GetNode ()->GetId () << "-" << device->GetIfIndex ();
+  Ptr<WifiNetDevice> wifi = DynamicCast<WifiNetDevice> (device);
+  if (wifi)
+    {
+      WriteInterface (LINKTYPE_IEEE802_11_RADIOTAP, name.str ());
+      wifi->GetPhy ()->TraceConnectWithoutContext ("MonitorSnifferRx", MakeBoundCallback (&PcapngFile::WifiRxSniffer, iface));
+      wifi->GetPhy ()->TraceConnectWithoutContext ("MonitorSnifferTx", MakeBoundCallback (&PcapngFile::WifiTxSniffer, iface));
+      return;
+    }
+  if (DynamicCast<PointToPointNetDevice> (device))
+    {
+      WriteInterface (LINKTYPE_PPP, name.str ());
+    }
+  else if (DynamicCast<CsmaNetDevice> (device))
+    {
+      WriteInterface (LINKTYPE_ETHERNET, name.str ());
+    }
+  else
+    {
+      NS_FATAL_ERROR ("PcapngFile: unsupported device " << device->GetInstanceTypeId ().GetName ());
+    }
+  device->TraceConnectWithoutContext ("PromiscSniffer", MakeBoundCallback (&PcapngFile::PacketSniffer, iface));
+}
+
+void
+PcapngFile::WriteInterface (uint16_t linkType, std::string name)
+{
+  uint32_t namePadded = (name.size () + 3) & ~3u;
+  // header, linktype/reserved, snaplen, if_name, if_tsresol, opt_endofopt, trailer
+  uint32_t length = 8 + 4 + 4 + (4 + namePadded) + (4 + 4) + 4 + 4;
+  uint32_t header[] = { 0x00000001, length };
+  uint16_t link[] = { linkType, 0 };
+  uint32_t snapLen = SNAP_LEN;
+  uint16_t nameOption[] = { 2, uint16_t (name.size ()) };
+  uint16_t resolutionOption[] = { 9, 1 };
+  uint8_t resolution[4] = { 9, 0, 0, 0 };
+  uint32_t end = 0;
+  uint8_t pad[4] = { 0, 0, 0, 0 };
+
+  Put (header, sizeof (header));
+  Put (link, sizeof (link));
+  Put (&snapLen, sizeof (snapLen));
+  Put (nameOption, sizeof (nameOption));
+  Put (name.data (), name.size ());
+  Put (pad, namePadded - name.size ());
+  Put (resolutionOption, sizeof (resolutionOption));
+  Put (resolution, sizeof (resolution));
+  Put (&end, sizeof (end));
+  Put (&length, sizeof (length));
+}
+
+void
+PcapngFile::WritePacket (uint32_t id, const uint8_t *radiotap, uint32_t radiotapSize, Ptr<const Packet> packet)
+{
+  uint32_t size = radiotapSize + packet->GetSize ();
+  uint32_t captured = size < SNAP_LEN ? size : SNAP_LEN;
+  m_buffer.resize ((captured + 3) & ~3u);
+  std::fill (m_buffer.begin () + captured, m_buffer.end (), 0);
+  std::copy (radiotap, radiotap + radiotapSize, m_buffer.begin ());
+  packet->CopyData (m_buffer.data () + radiotapSize, captured - radiotapSize);
+
+  uint64_t ns = Simulator::Now ().GetNanoSeconds ();
+  uint32_t length = 32 + m_buffer.size ();
+  uint32_t header[] = { 0x00000006, length, id, uint32_t (ns >> 32), uint32_t (ns), captured, size };
+  Put (header, sizeof (header));
+  Put (m_buffer.data (), m_buffer.size ());
+  Put (&length, sizeof (length));
+}
+
+uint32_t
+PcapngFile::Radiotap (uint8_t *buffer, uint16_t channelFreqMhz, WifiTxVector txVector,
+                      const SignalNoiseDbm *signalNoise)
+{
+  WifiModulationClass modClass = txVector.GetMode ().GetModulationClass ();
+  bool dsss = modClass == WIFI_MOD_CLASS_DSSS || modClass == WIFI_MOD_CLASS_HR_DSSS;
+  uint16_t length = signalNoise ? 16 : 14;
+  // flags, rate, channel and, when received, dBm antenna signal and noise
+  uint32_t present = (1 << 1) | (1 << 2) | (1 << 3) | (signalNoise ? (1 << 5) | (1 << 6) : 0);
+  uint16_t channelFlags = (channelFreqMhz < 2500 ? 0x0080 : 0x0100) | (dsss ? 0x0020 : 0x0040);
+
+  buffer[0] = 0;
+  buffer[1] = 0;
+  std::memcpy (buffer + 2, &length, 2);
+  std::memcpy (buffer + 4, &present, 4);
+  // ns-3 frames carry their FCS
+  buffer[8] = 0x10 | (txVector.GetPreambleType () == WIFI_PREAMBLE_SHORT ? 0x02 : 0);
+  buffer[9] = txVector.GetMode ().GetDataRate (txVector) / 500000;
+  std::memcpy (buffer + 10, &channelFreqMhz, 2);
+  std::memcpy (buffer + 12, &channelFlags, 2);
+  if (signalNoise)
+    {
+      buffer[14] = int8_t (std::floor (signalNoise->signal + 0.5));
+      buffer[15] = int8_t (std::floor (signalNoise->noise + 0.5));
+    }
+  return length;
+}
+
+void
+PcapngFile::Put (const void *data, uint32_t size)
+{
+  if (size > 0 && std::fwrite (data, size, 1, m_file) != 1)
+    {
+      NS_FATAL_ERROR ("Cannot write " << m_filename << ": " << std::strerror (errno));
+    }
+}
+
+void
+PcapngFile::PacketSniffer (Interface *iface, Ptr<const Packet> packet)
+{
+  iface->file->WritePacket (iface->id, 0, 0, packet);
+}
+
+void
+PcapngFile::WifiRxSniffer (Interface *iface, Ptr<const Packet> packet, uint16_t channelFreqMhz,
+                           WifiTxVector txVector, MpduInfo aMpdu, SignalNoiseDbm signalNoise)
+{
+  uint8_t radiotap[16];
+  uint32_t size = Radiotap (radiotap, channelFreqMhz, txVector, &signalNoise);
+  iface->file->WritePacket (iface->id, radiotap, size, packet);
+}
+
+void
+PcapngFile::WifiTxSniffer (Interface *iface, Ptr<const Packet> packet, uint16_t channelFreqMhz,
+                           WifiTxVector txVector, MpduInfo aMpdu)
+{
+  uint8_t radiotap[16];
+  uint32_t size = Radiotap (radiotap, channelFreqMhz, txVector, 0);
+  iface->file->WritePacket (iface->id, radiotap, size, packet);
+}
+
 int main (int argc, char *argv[]){
   bool verbose = true;
   uint32_t nWifi = 6;
   bool tracing = true;
+  bool cacheLoss = false;
 
   CommandLine cmd;
+  cmd.AddValue ("cacheLoss", "Memoize the propagation loss per link (see ns3::CachedPropagationLossModel::PositionEpsilon)", cacheLoss);
   cmd.AddValue ("nWifi", "Number of wifi STA devices", nWifi);
   cmd.AddValue ("verbose", "Tell echo applications to log if true", verbose);
   cmd.AddValue ("tracing", "Enable pcap tracing", tracing);
+  bool asyncTrace = false;
+  cmd.AddValue ("asyncTrace", "Write the ascii traces from a background thread", asyncTrace);
+  bool pcapng = false;
+  cmd.AddValue ("pcapng", "Capture every p2p and wifi device into the single file assignment1.pcapng", pcapng);
+  std::string animFormat = "xml";
+  double animMoveThreshold = 1.0;
+  double animPacketSample = 1.0;
+  cmd.AddValue ("animFormat", "NetAnim output: xml (third.xml) or binary (third.anim, see anim-bin2xml)", animFormat);
+  cmd.AddValue ("animMoveThreshold", "Binary NetAnim: meters a node moves before its position is written again", animMoveThreshold);
+  cmd.AddValue ("animPacketSample", "Binary NetAnim: fraction of each device's frames recorded", animPacketSample);
   bool enableCtsRts=false;
   UintegerValue ctsThr = (enableCtsRts ? UintegerValue (100) : UintegerValue (4028));
   Config::SetDefault ("ns3::WifiRemoteStationManager::RtsCtsThreshold", ctsThr);
@@ -84,7 +357,7 @@ int main (int argc, char *argv[]){
   NodeContainer wifiStaNodes1;
   wifiStaNodes1.Create (nWifi);
   NodeContainer wifiApNode1 = p2pNodes.Get (0);
-  YansWifiChannelHelper channel1 = YansWifiChannelHelper::Default ();
+  YansWifiChannelHelper channel1 = DefaultChannel (cacheLoss);
   YansWifiPhyHelper phy1 = YansWifiPhyHelper::Default ();
   phy1.SetChannel (channel1.Create ());
 
@@ -128,7 +401,7 @@ mobility1.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
   wifiStaNodes2.Create (nWifi);
   NodeContainer wifiApNode2 = p2pNodes.Get (1);
 
-  YansWifiChannelHelper channel2 = YansWifiChannelHelper::Default ();
+  YansWifiChannelHelper channel2 = DefaultChannel (cacheLoss);
   YansWifiPhyHelper phy2 = YansWifiPhyHelper::Default ();
   phy2.SetChannel (channel2.Create ());
 
@@ -236,7 +509,20 @@ monitor=flowmon.InstallAll();
 
   Simulator::Stop (Seconds (10.0));
 
-  if (tracing == true)
+  PcapngFile *pcapngFile = 0;
+  if (tracing == true && pcapng)
+    {
+      NetDeviceContainer captured (p2pDevices, apDevices1);
+      captured.Add (staDevices1);
+      captured.Add (apDevices2);
+      captured.Add (staDevices2);
+      pcapngFile = new PcapngFile ("assignment1.pcapng");
+      for (uint32_t i = 0; i < captured.GetN (); ++i)
+        {
+          pcapngFile->AddDevice (captured.Get (i));
+        }
+    }
+  else if (tracing == true)
     {
       pointToPoint.EnablePcapAll ("third");
       phy1.EnablePcap ("third", apDevices1.Get (0));
@@ -246,14 +532,36 @@ monitor=flowmon.InstallAll();
 //Ascii trace
 
 AsciiTraceHelper ascii;
+  std::vector<AsyncTraceFile *> asyncTraces;
+  if (asyncTrace)
+    {
+      asyncTraces.push_back (new AsyncTraceFile ("phy.tr"));
+      asyncTraces.push_back (new AsyncTraceFile ("phy2.tr"));
+      asyncTraces.push_back (new AsyncTraceFile ("p2p.tr"));
+      phy1.EnableAsciiAll (asyncTraces[0]->GetStream ());
+      phy2.EnableAsciiAll (asyncTraces[1]->GetStream ());
+      pointToPoint.EnableAsciiAll (asyncTraces[2]->GetStream ());
+    }
+  else
+    {
 phy1.EnableAsciiAll(ascii.CreateFileStream("phy.tr"));
 phy2.EnableAsciiAll(ascii.CreateFileStream("phy2.tr"));
 //csma.EnableAsciiAll(ascii.CreateFileStream("csma.tr"));
 pointToPoint.EnableAsciiAll(ascii.CreateFileStream("p2p.tr"));
+    }
 
 //NetAnim
 
-AnimationInterface anim("third.xml");
+  AnimationInterface *anim = 0;
+  AnimRecorder *animRecorder = 0;
+  if (animFormat == "binary")
+    {
+      animRecorder = new AnimRecorder ("third.anim", animMoveThreshold, animPacketSample);
+    }
+  else
+    {
+      anim = new AnimationInterface ("third.xml");
+    }
 
   Simulator::Run ();
 
@@ -278,5 +586,12 @@ monitor->CheckForLostPackets ();
     }
 
   Simulator::Destroy ();
+  for (uint32_t i = 0; i < asyncTraces.size (); ++i)
+    {
+      delete asyncTraces[i];
+    }
+  delete pcapngFile;
+  delete anim;
+  delete animRecorder;
   return 0;
 }
@@ -0,0 +1,175 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Ascii trace file written from a background thread, for the
+// --asyncTrace mode of third.cc and assignment1.cc.
+
+#ifndef ASYNC_TRACE_FILE_H
+#define ASYNC_TRACE_FILE_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * Output stream for AsciiTraceHelper sinks that keeps disk writes off
+ * the simulation thread. Trace text is collected in fixed-size blocks;
+ * each full block is handed to a writer thread through a lock-free
+ * single-producer, single-consumer ring, and the simulation only waits
+ * when the writer has fallen a whole ring behind. The per-line
+ * std::endl flushes of the sinks are ignored; the partial last block
+ * is written when the file is deleted, which must happen after
+ * Simulator::Destroy.
+ */
+class AsyncTraceFile : public std::streambuf
+{
+public:
+  AsyncTraceFile (std::string filename);
+  ~AsyncTraceFile ();
+  /// The stream to pass to EnableAscii*; it is only valid while this file lives
+  Ptr<OutputStreamWrapper> GetStream (void);
+
+protected:
+  virtual int_type overflow (int_type c);
+  virtual int sync (void);
+
+private:
+  static const uint32_t BLOCK_SIZE = 64 * 1024;
+  static const uint32_t RING_BLOCKS = 32;
+
+  struct Block
+  {
+    char data[BLOCK_SIZE];
+    uint32_t size;
+  };
+
+  /// Publish the block being filled and start filling the next free one
+  void Push (void);
+  void WriterLoop (void);
+
+  std::vector<Block> m_ring;
+  std::atomic<uint32_t> m_head;         //!< blocks published by the simulation thread
+  std::atomic<uint32_t> m_tail;         //!< blocks written by the writer thread
+  std::atomic<bool> m_done;
+  FILE *m_file;
+  std::ostream m_stream;
+  Ptr<OutputStreamWrapper> m_wrapper;
+  std::thread m_writer;
+};
+
+AsyncTraceFile::AsyncTraceFile (std::string filename)
+  : m_ring (RING_BLOCKS),
+    m_head (0),
+    m_tail (0),
+    m_done (false),
+    m_file (std::fopen (filename.c_str (), "w")),
+    m_stream (this)
+{
+  if (m_file == 0)
+    {
+      NS_FATAL_ERROR ("Cannot open trace file " << filename);
+    }
+  setp (m_ring[0].data, m_ring[0].data + BLOCK_SIZE);
+  m_wrapper = Create<OutputStreamWrapper> (&m_stream);
+  m_writer = std::thread (&AsyncTraceFile::WriterLoop, this);
+}
+
+AsyncTraceFile::~AsyncTraceFile ()
+{
+  Push ();
+  m_done.store (true, std::memory_order_release);
+  m_writer.join ();
+  std::fclose (m_file);
+}
+
+Ptr<OutputStreamWrapper>
+AsyncTraceFile::GetStream (void)
+{
+  return m_wrapper;
+}
+
+AsyncTraceFile::int_type
+AsyncTraceFile::overflow (int_type c)
+{
+  Push ();
+  if (!traits_type::eq_int_type (c, traits_type::eof ()))
+    {
+      *pptr () = traits_type::to_char_type (c);
+      pbump (1);
+    }
+  return traits_type::not_eof (c);
+}
+
+int
+AsyncTraceFile::sync (void)
+{
+  return 0;
+}
+
+void
+AsyncTraceFile::Push (void)
+{
+  uint32_t head = m_head.load (std::memory_order_relaxed);
+  m_ring[head % RING_BLOCKS].size = pptr () - pbase ();
+  ++head;
+  m_head.store (head, std::memory_order_release);
+  while (head - m_tail.load (std::memory_order_acquire) == RING_BLOCKS)
+    {
+      std::this_thread::yield ();
+    }
+  Block &next = m_ring[head % RING_BLOCKS];
+  setp (next.data, next.data + BLOCK_SIZE);
+}
+
+void
+AsyncTraceFile::WriterLoop (void)
+{
+  uint32_t tail = 0;
+  while (true)
+    {
+      if (tail == m_head.load (std::memory_order_acquire))
+        {
+          if (m_done.load (std::memory_order_acquire) && tail == m_head.load (std::memory_order_acquire))
+            {
+              break;
+            }
+          std::this_thread::sleep_for (std::chrono::microseconds (200));
+          continue;
+        }
+      Block const &block = m_ring[tail % RING_BLOCKS];
+      if (std::fwrite (block.data, 1, block.size, m_file) != block.size)
+        {
+          std::cerr << "AsyncTraceFile: write failed: " << std::strerror (errno) << std::endl;
+        }
+      m_tail.store (++tail, std::memory_order_release);
+    }
+}
+
+} // namespace ns3
+
+#endif /* ASYNC_TRACE_FILE_H */
@@ -0,0 +1,277 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Per-link memoizing propagation loss wrapper, for the --cacheLoss
+// mode of aodv_lab.cc and assignment1.cc.
+
+#ifndef CACHED_PROPAGATION_LOSS_MODEL_H
+#define CACHED_PROPAGATION_LOSS_MODEL_H
+
+#include "ns3/core-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/propagation-loss-model.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief Memoizes the rx power computed by another loss model per
+ * (tx, rx) pair.
+ *
+ * A cached value is reused as long as neither end has fired its
+ * CourseChange trace since, and each end that is moving is still
+ * within PositionEpsilon of where it was when the value was computed.
+ * Links between static nodes are thus computed only once, while links
+ * to a continuous mover are recomputed every frame unless
+ * PositionEpsilon is raised above 0.
+ *
+ * The wrapped model must be deterministic: memoizing a random one
+ * such as NakagamiPropagationLossModel would freeze its first draw per
+ * link. When the model is set, its chain is walked with GetNext and
+ * the loss models ns-3 knows to draw random numbers are refused with
+ * a fatal error; models chained on after that are not checked.
+ *
+ * Every mobility model seen gets a dense index, and the entries live
+ * in a flat table indexed by (tx, rx), so a lookup costs one hash probe
+ * for the receiver (the sender is remembered from the previous call,
+ * since a frame asks for all its receivers in a row). Whether an end
+ * is moving is read from its velocity when it is first seen and on
+ * every CourseChange, which mobility models fire whenever their
+ * velocity changes, so a static end costs no GetVelocity or
+ * GetPosition call at all.
+ */
+class CachedPropagationLossModel : public PropagationLossModel
+{
+public:
+  static TypeId GetTypeId (void);
+  CachedPropagationLossModel ();
+  virtual ~CachedPropagationLossModel ();
+
+  /// Wrap model, which must be deterministic
+  void SetModel (Ptr<PropagationLossModel> model);
+  Ptr<PropagationLossModel> GetModel (void) const;
+
+private:
+  /// What is known about one mobility model
+  struct End
+  {
+    uint32_t version;   ///< course changes seen
+    bool moving;        ///< velocity was non-zero at the last course change
+  };
+  /// A computed rx power and the state of both ends it was computed for
+  struct Entry
+  {
+    bool valid;
+    double txPowerDbm;
+    double rxPowerDbm;
+    uint32_t txVersion;
+    uint32_t rxVersion;
+    Vector txPosition;
+    Vector rxPosition;
+  };
+
+  virtual double DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+  virtual int64_t DoAssignStreams (int64_t stream);
+
+  /// \return the index of m, connecting to its CourseChange when first seen
+  uint32_t GetIndex (Ptr<MobilityModel> m) const;
+  /// \return whether m, the end index, moved further than PositionEpsilon from position
+  bool HasMoved (uint32_t index, Ptr<MobilityModel> m, Vector const &position) const;
+  void CourseChanged (Ptr<const MobilityModel> m) const;
+  static bool IsMoving (Ptr<const MobilityModel> m);
+  /// \return whether model is one of the random loss models
+  static bool IsRandom (Ptr<PropagationLossModel> model);
+
+  Ptr<PropagationLossModel> m_model;
+  double m_epsilon;
+  mutable std::unordered_map<const MobilityModel *, uint32_t> m_indices;
+  mutable std::vector<End> m_ends;
+  mutable const MobilityModel *m_lastTx;
+  mutable uint32_t m_lastTxIndex;
+  mutable std::vector<Entry> m_cache;   ///< m_stride * m_stride entries, row tx, column rx
+  mutable uint32_t m_stride;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CachedPropagationLossModel);
+
+TypeId
+CachedPropagationLossModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CachedPropagationLossModel")
+    .SetParent<PropagationLossModel> ()
+    .SetGroupName ("Propagation")
+    .AddConstructor<CachedPropagationLossModel> ()
+    .AddAttribute ("Model", "The loss model whose results are cached; it must be deterministic.",
+                   PointerValue (),
+                   MakePointerAccessor (&CachedPropagationLossModel::SetModel,
+                                        &CachedPropagationLossModel::GetModel),
+                   MakePointerChecker<PropagationLossModel> ())
+    .AddAttribute ("PositionEpsilon", "How far (m) a moving node may drift before its links are recomputed.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&CachedPropagationLossModel::m_epsilon),
+                   MakeDoubleChecker<double> (0.0))
+  ;
+  return tid;
+}
+
+CachedPropagationLossModel::CachedPropagationLossModel ()
+  : PropagationLossModel (),
+    m_epsilon (0.0),
+    m_lastTx (0),
+    m_lastTxIndex (0),
+    m_stride (0)
+{
+}
+
+CachedPropagationLossModel::~CachedPropagationLossModel ()
+{
+}
+
+bool
+CachedPropagationLossModel::IsRandom (Ptr<PropagationLossModel> model)
+{
+  // Looked up by name, since the buildings models may not be built
+  const char *random[] = { "ns3::RandomPropagationLossModel", "ns3::NakagamiPropagationLossModel",
+                           "ns3::JakesPropagationLossModel", "ns3::BuildingsPropagationLossModel" };
+  TypeId tid = model->GetInstanceTypeId ();
+  for (size_t i = 0; i < sizeof (random) / sizeof (random[0]); ++i)
+    {
+      TypeId randomTid;
+      if (TypeId::LookupByNameFailSafe (random[i], &randomTid) && tid.IsChildOf (randomTid))
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+void
+CachedPropagationLossModel::SetModel (Ptr<PropagationLossModel> model)
+{
+  for (Ptr<PropagationLossModel> m = model; m != 0; m = m->GetNext ())
+    {
+      if (IsRandom (m))
+        {
+          NS_FATAL_ERROR ("CachedPropagationLossModel cannot memoize the random "
+                          << m->GetInstanceTypeId ().GetName ());
+        }
+    }
+  m_model = model;
+}
+
+Ptr<PropagationLossModel>
+CachedPropagationLossModel::GetModel (void) const
+{
+  return m_model;
+}
+
+bool
+CachedPropagationLossModel::IsMoving (Ptr<const MobilityModel> m)
+{
+  Vector v = m->GetVelocity ();
+  return v.x != 0 || v.y != 0 || v.z != 0;
+}
+
+uint32_t
+CachedPropagationLossModel::GetIndex (Ptr<MobilityModel> m) const
+{
+  std::unordered_map<const MobilityModel *, uint32_t>::const_iterator it = m_indices.find (PeekPointer (m));
+  if (it != m_indices.end ())
+    {
+      return it->second;
+    }
+  uint32_t index = m_ends.size ();
+  m_indices[PeekPointer (m)] = index;
+  End end = { 0, IsMoving (m) };
+  m_ends.push_back (end);
+  m->TraceConnectWithoutContext ("CourseChange", MakeCallback (&CachedPropagationLossModel::CourseChanged, this));
+
+  if (index >= m_stride)
+    {
+      uint32_t stride = m_stride ? 2 * m_stride : 16;
+      Entry invalid = Entry ();
+      std::vector<Entry> cache (size_t (stride) * stride, invalid);
+      for (uint32_t tx = 0; tx < m_stride; ++tx)
+        {
+          std::copy (m_cache.begin () + size_t (tx) * m_stride, m_cache.begin () + size_t (tx + 1) * m_stride,
+                     cache.begin () + size_t (tx) * stride);
+        }
+      m_cache.swap (cache);
+      m_stride = stride;
+    }
+  return index;
+}
+
+void
+CachedPropagationLossModel::CourseChanged (Ptr<const MobilityModel> m) const
+{
+  End &end = m_ends[m_indices[PeekPointer (m)]];
+  ++end.version;
+  end.moving = IsMoving (m);
+}
+
+bool
+CachedPropagationLossModel::HasMoved (uint32_t index, Ptr<MobilityModel> m, Vector const &position) const
+{
+  // A node without velocity can only move through SetPosition, which
+  // fires CourseChange and is caught by the version check.
+  if (!m_ends[index].moving)
+    {
+      return false;
+    }
+  return CalculateDistance (m->GetPosition (), position) > m_epsilon;
+}
+
+double
+CachedPropagationLossModel::DoCalcRxPower (double txPowerDbm,
+                                           Ptr<MobilityModel> a,
+                                           Ptr<MobilityModel> b) const
+{
+  if (PeekPointer (a) != m_lastTx)
+    {
+      m_lastTxIndex = GetIndex (a);
+      m_lastTx = PeekPointer (a);
+    }
+  uint32_t tx = m_lastTxIndex;
+  uint32_t rx = GetIndex (b);
+  Entry &e = m_cache[size_t (tx) * m_stride + rx];
+  if (e.valid && e.txVersion == m_ends[tx].version && e.rxVersion == m_ends[rx].version
+      && e.txPowerDbm == txPowerDbm
+      && !HasMoved (tx, a, e.txPosition) && !HasMoved (rx, b, e.rxPosition))
+    {
+      return e.rxPowerDbm;
+    }
+  e.valid = true;
+  e.txPowerDbm = txPowerDbm;
+  e.rxPowerDbm = m_model->CalcRxPower (txPowerDbm, a, b);
+  e.txVersion = m_ends[tx].version;
+  e.rxVersion = m_ends[rx].version;
+  e.txPosition = a->GetPosition ();
+  e.rxPosition = b->GetPosition ();
+  return e.rxPowerDbm;
+}
+
+int64_t
+CachedPropagationLossModel::DoAssignStreams (int64_t stream)
+{
+  return m_model->AssignStreams (stream);
+}
+
+} // namespace ns3
+
+#endif /* CACHED_PROPAGATION_LOSS_MODEL_H */
@@ -0,0 +1,397 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Running the experiments of a program in forked child processes, each
+// with a fresh Simulator, for 2.cc, 4.cc, aodv_lab.cc, expossed.cc and
+// wifi-hidden-terminal.cc, and the rate manager sweep of 2.cc and
+// expossed.cc.
+
+#ifndef CHILD_PROCESSES_H
+#define CHILD_PROCESSES_H
+
+#include "ns3/core-module.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Run every job in its own child process, so that each one gets a
+ * fresh Simulator, and return what each child printed, in job order.
+ */
+inline std::vector<std::string>
+RunInChildren (std::vector<std::function<void ()> > const &jobs)
+{
+  std::vector<int> fds;
+  std::vector<pid_t> pids;
+  std::cout << std::flush;
+  for (size_t j = 0; j < jobs.size (); ++j)
+    {
+      int fd[2];
+      if (pipe (fd) != 0)
+        {
+          NS_FATAL_ERROR ("pipe () failed: " << std::strerror (errno));
+        }
+      pid_t pid = fork ();
+      if (pid < 0)
+        {
+          NS_FATAL_ERROR ("fork () failed: " << std::strerror (errno));
+        }
+      if (pid == 0)
+        {
+          close (fd[0]);
+          dup2 (fd[1], STDOUT_FILENO);
+          close (fd[1]);
+          jobs[j] ();
+          std::cout << std::flush;
+          _exit (0);
+        }
+      close (fd[1]);
+      fds.push_back (fd[0]);
+      pids.push_back (pid);
+    }
+
+  // Children do not depend on each other, so draining the pipes one
+  // after the other cannot dead-lock on a full pipe.
+  std::vector<std::string> output (jobs.size ());
+  for (size_t j = 0; j < jobs.size (); ++j)
+    {
+      char buf[4096];
+      ssize_t n;
+      while ((n = read (fds[j], buf, sizeof (buf))) > 0)
+        {
+          output[j].append (buf, n);
+        }
+      close (fds[j]);
+      int status;
+      waitpid (pids[j], &status, 0);
+      if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          NS_FATAL_ERROR ("experiment child " << pids[j] << " did not exit cleanly");
+        }
+    }
+  return output;
+}
+
+/**
+ * Run the jobs 0 .. nJobs - 1 on at most nWorkers concurrent child
+ * processes, handing each job to whichever worker slot frees up first.
+ *
+ * job runs in the child and returns a trivially copyable Result, which
+ * is sent back through a pipe. done is called in the parent with each
+ * result as soon as its child exits, so in completion order, and
+ * returns whether to go on: once it returns false no further job is
+ * started and the children still running are killed. A child that
+ * does not exit cleanly gets the others killed and is a fatal error.
+ * abandon, if set, is called for every job whose child was killed or
+ * failed, to remove what the child could not clean up itself.
+ */
+template <typename Result>
+inline void
+RunJobPool (uint32_t nJobs, uint32_t nWorkers,
+            std::function<Result (uint32_t)> const &job,
+            std::function<bool (uint32_t, Result const &)> const &done,
+            std::function<void (uint32_t)> const &abandon = std::function<void (uint32_t)> ())
+{
+  struct Worker
+  {
+    pid_t pid;
+    uint32_t job;
+    int fd;             ///< read end of the result pipe
+    std::string result; ///< what was read from fd so far
+  };
+  std::vector<Worker> running;
+  auto killAll = [&running, &abandon] ()
+  {
+    for (size_t i = 0; i < running.size (); ++i)
+      {
+        kill (running[i].pid, SIGKILL);
+        waitpid (running[i].pid, 0, 0);
+        close (running[i].fd);
+        if (abandon)
+          {
+            abandon (running[i].job);
+          }
+      }
+    running.clear ();
+  };
+
+  uint32_t next = 0;
+  bool stop = false;
+  std::cout << std::flush;
+  while (!stop && (next < nJobs || !running.empty ()))
+    {
+      while (next < nJobs && running.size () < nWorkers)
+        {
+          int fd[2];
+          if (pipe (fd) != 0)
+            {
+              NS_FATAL_ERROR ("pipe () failed: " << std::strerror (errno));
+            }
+          pid_t pid = fork ();
+          if (pid < 0)
+            {
+              NS_FATAL_ERROR ("fork () failed: " << std::strerror (errno));
+            }
+          if (pid == 0)
+            {
+              close (fd[0]);
+              Result r = job (next);
+              const char *p = reinterpret_cast<const char *> (&r);
+              size_t left = sizeof (r);
+              ssize_t n;
+              while (left > 0 && (n = write (fd[1], p, left)) > 0)
+                {
+                  p += n;
+                  left -= n;
+                }
+              _exit (left == 0 ? 0 : 1);
+            }
+          close (fd[1]);
+          Worker worker = { pid, next, fd[0], std::string () };
+          running.push_back (worker);
+          ++next;
+        }
+
+      // Every pipe is drained as it fills, so a result larger than the
+      // pipe buffer cannot keep its child from exiting
+      std::vector<struct pollfd> fds (running.size ());
+      for (size_t i = 0; i < running.size (); ++i)
+        {
+          fds[i].fd = running[i].fd;
+          fds[i].events = POLLIN;
+          fds[i].revents = 0;
+        }
+      if (poll (&fds[0], fds.size (), -1) < 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          NS_FATAL_ERROR ("poll () failed: " << std::strerror (errno));
+        }
+      for (size_t i = fds.size (); i-- > 0 && !stop; )
+        {
+          if (fds[i].revents == 0)
+            {
+              continue;
+            }
+          char buf[4096];
+          ssize_t n = read (running[i].fd, buf, sizeof (buf));
+          if (n > 0)
+            {
+              running[i].result.append (buf, n);
+              continue;
+            }
+          if (n < 0 && errno == EINTR)
+            {
+              continue;
+            }
+          // End of file: the child is done
+          Worker worker = running[i];
+          running.erase (running.begin () + i);
+          close (worker.fd);
+          int status;
+          waitpid (worker.pid, &status, 0);
+          if (!WIFEXITED (status) || WEXITSTATUS (status) != 0 || worker.result.size () != sizeof (Result))
+            {
+              if (abandon)
+                {
+                  abandon (worker.job);
+                }
+              killAll ();
+              NS_FATAL_ERROR ("job " << worker.job << " worker " << worker.pid << " did not exit cleanly");
+            }
+          Result r;
+          std::memcpy (&r, worker.result.data (), sizeof (r));
+          stop = !done (worker.job, r);
+        }
+    }
+  killAll ();
+}
+
+/// Totals over all flows of one experiment
+struct ExperimentSummary
+{
+  uint64_t txPackets;
+  uint64_t rxPackets;
+  uint64_t rxBytes;
+};
+
+/// One point of the wifiManager x RtsCtsThreshold x RngRun sweep
+struct SweepJob
+{
+  std::string wifiManager;
+  bool enableCtsRts;
+  uint32_t run;
+};
+
+/// \return the throughput in Mbps of a 2 second flow
+inline double
+SweepThroughput (ExperimentSummary const &s)
+{
+  return s.rxBytes * 8.0 / 2.0 / 1000 / 1000;
+}
+
+/// \return the percentage of transmitted packets that were lost
+inline double
+SweepLoss (ExperimentSummary const &s)
+{
+  return s.txPackets ? (s.txPackets - s.rxPackets) * 100.0 / s.txPackets : 0;
+}
+
+/**
+ * Run experiment for every rate manager x RTS/CTS on/off x RngRun
+ * 1 .. runs on at most nWorkers concurrent worker processes.
+ *
+ * Each result row is printed as soon as its worker exits. A per
+ * (wifiManager, RTS/CTS) summary over all runs is printed once every
+ * job has finished.
+ */
+inline void
+RunSweep (std::function<ExperimentSummary (SweepJob const &)> const &experiment, uint32_t runs, uint32_t nWorkers)
+{
+  const char *managers[] = { "Aarf", "Aarfcd", "Amrr", "Arf", "Cara", "Ideal", "Minstrel", "Onoe", "Rraa" };
+  std::vector<SweepJob> jobs;
+  for (size_t m = 0; m < sizeof (managers) / sizeof (managers[0]); ++m)
+    {
+      for (int rts = 0; rts < 2; ++rts)
+        {
+          for (uint32_t run = 1; run <= runs; ++run)
+            {
+              SweepJob job = { managers[m], rts == 1, run };
+              jobs.push_back (job);
+            }
+        }
+    }
+  std::vector<ExperimentSummary> results (jobs.size ());
+
+  std::cout << std::setw (10) << "Manager" << std::setw (8) << "RTS/CTS" << std::setw (6) << "Run"
+            << std::setw (10) << "TxPkts" << std::setw (10) << "RxPkts"
+            << std::setw (12) << "Thr(Mbps)" << std::setw (10) << "Loss(%)" << "\n";
+  RunJobPool<ExperimentSummary> (jobs.size (), nWorkers,
+    [&jobs, &experiment] (uint32_t j)
+    {
+      ns3::RngSeedManager::SetRun (jobs[j].run);
+      return experiment (jobs[j]);
+    },
+    [&jobs, &results] (uint32_t j, ExperimentSummary const &summary)
+    {
+      results[j] = summary;
+      std::cout << std::setw (10) << jobs[j].wifiManager << std::setw (8) << (jobs[j].enableCtsRts ? "on" : "off")
+                << std::setw (6) << jobs[j].run << std::setw (10) << summary.txPackets
+                << std::setw (10) << summary.rxPackets
+                << std::setw (12) << SweepThroughput (summary)
+                << std::setw (10) << SweepLoss (summary) << "\n" << std::flush;
+      return true;
+    });
+
+  std::cout << "------------------------------------------------\n";
+  std::cout << std::setw (10) << "Manager" << std::setw (8) << "RTS/CTS" << std::setw (6) << "Runs"
+            << std::setw (12) << "Thr(Mbps)" << std::setw (10) << "Loss(%)" << "\n";
+  for (size_t first = 0; first < jobs.size (); )
+    {
+      size_t last = first;
+      double throughput = 0;
+      double loss = 0;
+      while (last < jobs.size ()
+             && jobs[last].wifiManager == jobs[first].wifiManager
+             && jobs[last].enableCtsRts == jobs[first].enableCtsRts)
+        {
+          throughput += SweepThroughput (results[last]);
+          loss += SweepLoss (results[last]);
+          ++last;
+        }
+      std::cout << std::setw (10) << jobs[first].wifiManager << std::setw (8) << (jobs[first].enableCtsRts ? "on" : "off")
+                << std::setw (6) << last - first << std::setw (12) << throughput / (last - first)
+                << std::setw (10) << loss / (last - first) << "\n";
+      first = last;
+    }
+}
+
+/**
+ * \return the wall-clock time in ms of the last TimedSimulatorRun, or -1
+ * if there was none
+ */
+inline int64_t &
+LastRunWallClockMs (void)
+{
+  static int64_t ms = -1;
+  return ms;
+}
+
+/**
+ * Simulator::Run, recording its wall-clock time for BenchmarkSchedulers
+ * so that building the scenario and writing the results are not
+ * counted.
+ */
+inline void
+TimedSimulatorRun (void)
+{
+  ns3::SystemWallClockMs clock;
+  clock.Start ();
+  ns3::Simulator::Run ();
+  LastRunWallClockMs () = clock.End ();
+}
+
+/**
+ * Time one run under each of the event schedulers shipped with ns-3.
+ *
+ * Every run happens in a fresh child process, one after the other, so
+ * all of them see the same event sequence and none competes for a core.
+ * Only Simulator::Run is timed, so run must call TimedSimulatorRun.
+ */
+inline void
+BenchmarkSchedulers (std::function<void ()> const &run)
+{
+  const char *schedulers[] = { "ns3::MapScheduler", "ns3::HeapScheduler", "ns3::ListScheduler", "ns3::CalendarScheduler" };
+  std::cout << std::setw (24) << "Scheduler" << std::setw (12) << "Wall(ms)" << "\n" << std::flush;
+  for (size_t s = 0; s < sizeof (schedulers) / sizeof (schedulers[0]); ++s)
+    {
+      pid_t pid = fork ();
+      if (pid < 0)
+        {
+          NS_FATAL_ERROR ("fork () failed: " << std::strerror (errno));
+        }
+      if (pid == 0)
+        {
+          ns3::GlobalValue::Bind ("SchedulerType", ns3::StringValue (schedulers[s]));
+          run ();
+          if (LastRunWallClockMs () < 0)
+            {
+              NS_FATAL_ERROR ("The benchmarked job did not call TimedSimulatorRun");
+            }
+          std::cout << std::setw (24) << schedulers[s] << std::setw (12) << LastRunWallClockMs () << "\n" << std::flush;
+          _exit (0);
+        }
+      int status;
+      waitpid (pid, &status, 0);
+      if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          NS_FATAL_ERROR ("benchmark child " << pid << " did not exit cleanly");
+        }
+    }
+}
+
+#endif /* CHILD_PROCESSES_H */
@@ -0,0 +1,227 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// MatrixPropagationLossModel stored as a dense array, for 4.cc,
+// expossed.cc and wifi-hidden-terminal.cc.
+
+#ifndef DENSE_MATRIX_PROPAGATION_LOSS_MODEL_H
+#define DENSE_MATRIX_PROPAGATION_LOSS_MODEL_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/propagation-loss-model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief A MatrixPropagationLossModel stored as a dense array
+ *
+ * Every mobility model gets a dense index the first time it is seen,
+ * and the losses live in one contiguous array instead of an ordered
+ * map of (tx, rx) pairs, so a lookup is two hash probes and one array
+ * access. The array is laid out in square shells (entry (i, j) is in
+ * shell max (i, j)), or as a packed upper triangle when the model is
+ * symmetric, so adding a node only appends to it.
+ */
+class DenseMatrixPropagationLossModel : public PropagationLossModel
+{
+public:
+  static TypeId GetTypeId (void);
+  DenseMatrixPropagationLossModel ();
+  virtual ~DenseMatrixPropagationLossModel ();
+
+  /**
+   * \param a the mobility of the transmitter
+   * \param b the mobility of the receiver
+   * \param loss the loss from a to b, dB
+   * \param symmetric whether to set the loss from b to a as well
+   */
+  void SetLoss (Ptr<MobilityModel> a, Ptr<MobilityModel> b, double loss, bool symmetric = true);
+  /// \param defaultLoss the loss of every link not set explicitly, dB
+  void SetDefaultLoss (double defaultLoss);
+  /**
+   * Set the losses between all nodes in one go from a text file holding
+   * nodes.GetN () rows of nodes.GetN () whitespace separated values in
+   * dB. Row i, column j is the loss from node i to node j; the diagonal
+   * is ignored.
+   */
+  void LoadFromFile (std::string filename, NodeContainer const &nodes);
+
+private:
+  virtual double DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+  virtual int64_t DoAssignStreams (int64_t stream);
+
+  /// \return the dense index of m, assigning the next free one if needed
+  uint32_t Index (Ptr<MobilityModel> m);
+  /// \return the position of entry (i, j) in m_loss
+  std::size_t Offset (uint32_t i, uint32_t j) const;
+
+  double m_default;
+  bool m_symmetric;
+  std::unordered_map<const MobilityModel *, uint32_t> m_index;
+  std::vector<Ptr<MobilityModel> > m_models; ///< keeps the index keys alive
+  std::vector<double> m_loss;                ///< NaN for links left at the default
+};
+
+NS_OBJECT_ENSURE_REGISTERED (DenseMatrixPropagationLossModel);
+
+TypeId
+DenseMatrixPropagationLossModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::DenseMatrixPropagationLossModel")
+    .SetParent<PropagationLossModel> ()
+    .SetGroupName ("Propagation")
+    .AddConstructor<DenseMatrixPropagationLossModel> ()
+    .AddAttribute ("DefaultLoss", "The default value for propagation loss, dB.",
+                   DoubleValue (std::numeric_limits<double>::max ()),
+                   MakeDoubleAccessor (&DenseMatrixPropagationLossModel::m_default),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("Symmetric", "Store only one loss per node pair. "
+                   "Must not be changed once losses have been set.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&DenseMatrixPropagationLossModel::m_symmetric),
+                   MakeBooleanChecker ())
+  ;
+  return tid;
+}
+
+DenseMatrixPropagationLossModel::DenseMatrixPropagationLossModel ()
+  : PropagationLossModel (),
+    m_default (std::numeric_limits<double>::max ()),
+    m_symmetric (false)
+{
+}
+
+DenseMatrixPropagationLossModel::~DenseMatrixPropagationLossModel ()
+{
+}
+
+void
+DenseMatrixPropagationLossModel::SetDefaultLoss (double loss)
+{
+  m_default = loss;
+}
+
+uint32_t
+DenseMatrixPropagationLossModel::Index (Ptr<MobilityModel> m)
+{
+  std::pair<std::unordered_map<const MobilityModel *, uint32_t>::iterator, bool> res =
+    m_index.insert (std::make_pair (PeekPointer (m), m_models.size ()));
+  if (res.second)
+    {
+      uint32_t n = m_models.size () + 1;
+      m_models.push_back (m);
+      m_loss.resize (m_symmetric ? n * (n + 1) / 2 : n * n, std::numeric_limits<double>::quiet_NaN ());
+    }
+  return res.first->second;
+}
+
+std::size_t
+DenseMatrixPropagationLossModel::Offset (uint32_t i, uint32_t j) const
+{
+  if (m_symmetric)
+    {
+      if (i > j)
+        {
+          std::swap (i, j);
+        }
+      return std::size_t (j) * (j + 1) / 2 + i;
+    }
+  if (i >= j)
+    {
+      return std::size_t (i) * i + j;
+    }
+  return std::size_t (j) * j + j + 1 + i;
+}
+
+void
+DenseMatrixPropagationLossModel::SetLoss (Ptr<MobilityModel> a, Ptr<MobilityModel> b, double loss, bool symmetric)
+{
+  NS_ASSERT_MSG (a != b, "Self-loss is not defined");
+  NS_ASSERT_MSG (symmetric || !m_symmetric, "Asymmetric loss set on a symmetric model");
+  uint32_t i = Index (a);
+  uint32_t j = Index (b);
+  m_loss[Offset (i, j)] = loss;
+  if (symmetric)
+    {
+      m_loss[Offset (j, i)] = loss;
+    }
+}
+
+void
+DenseMatrixPropagationLossModel::LoadFromFile (std::string filename, NodeContainer const &nodes)
+{
+  std::ifstream in (filename.c_str ());
+  if (!in)
+    {
+      NS_FATAL_ERROR ("Cannot open loss matrix " << filename);
+    }
+  uint32_t n = nodes.GetN ();
+  std::vector<uint32_t> index (n);
+  for (uint32_t i = 0; i < n; ++i)
+    {
+      index[i] = Index (nodes.Get (i)->GetObject<MobilityModel> ());
+    }
+  for (uint32_t i = 0; i < n; ++i)
+    {
+      for (uint32_t j = 0; j < n; ++j)
+        {
+          double loss;
+          if (!(in >> loss))
+            {
+              NS_FATAL_ERROR ("Loss matrix " << filename << " has fewer than " << n << "x" << n << " values");
+            }
+          if (i != j && (!m_symmetric || i < j))
+            {
+              m_loss[Offset (index[i], index[j])] = loss;
+            }
+        }
+    }
+}
+
+double
+DenseMatrixPropagationLossModel::DoCalcRxPower (double txPowerDbm,
+                                                Ptr<MobilityModel> a,
+                                                Ptr<MobilityModel> b) const
+{
+  std::unordered_map<const MobilityModel *, uint32_t>::const_iterator i = m_index.find (PeekPointer (a));
+  std::unordered_map<const MobilityModel *, uint32_t>::const_iterator j = m_index.find (PeekPointer (b));
+  if (i == m_index.end () || j == m_index.end ())
+    {
+      return txPowerDbm - m_default;
+    }
+  double loss = m_loss[Offset (i->second, j->second)];
+  return txPowerDbm - (std::isnan (loss) ? m_default : loss);
+}
+
+int64_t
+DenseMatrixPropagationLossModel::DoAssignStreams (int64_t stream)
+{
+  return 0;
+}
+
+} // namespace ns3
+
+#endif /* DENSE_MATRIX_PROPAGATION_LOSS_MODEL_H */
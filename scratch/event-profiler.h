@@ -0,0 +1,413 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Scheduler wrapper that profiles the events a simulation runs, for the
+// --profile mode of 4.cc and aodv_lab.cc.
+
+#ifndef EVENT_PROFILER_H
+#define EVENT_PROFILER_H
+
+#include "ns3/core-module.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief Forwards to another scheduler and profiles the events it hands
+ * out.
+ *
+ * Every event taken off the queue is counted against the dynamic type
+ * of its EventImpl, and the wall-clock time until the simulator comes
+ * back to the queue (IsEmpty or the next RemoveNext) is added to it.
+ * With a SamplingPeriod of N only every Nth event is timed, and its
+ * time counted N times, which leaves two clock reads per N events.
+ * When the simulator is destroyed the totals are written to Output,
+ * most expensive first, and as folded stacks
+ * (module;class;handler microseconds) for flamegraph.pl to
+ * Output.folded.
+ *
+ * Member function events are told apart by class and signature, as the
+ * event type does not name the method. The module is the TypeId group
+ * of the class, or else its namespace.
+ *
+ * Simulator::SetScheduler moves the queued events by taking them off
+ * the old scheduler with RemoveNext, so a profiler that a newer one
+ * has been created after (e.g. by a wrapper such as the
+ * LiveStatsScheduler of aodv_lab.cc, around the same SchedulerType)
+ * counts nothing from then on, hands what it has counted to the newer
+ * profiler and writes no report of its own.
+ */
+class EventProfilingScheduler : public Scheduler
+{
+public:
+  static TypeId GetTypeId (void);
+  EventProfilingScheduler ();
+  virtual ~EventProfilingScheduler ();
+
+  virtual void Insert (const Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Event PeekNext (void) const;
+  virtual Event RemoveNext (void);
+  virtual void Remove (const Event &ev);
+
+private:
+  typedef std::chrono::steady_clock Clock;
+  struct Profile
+  {
+    uint64_t events;
+    double seconds;
+  };
+
+  void SetScheduler (TypeId tid);
+  void SetSamplingPeriod (uint32_t period);
+  uint32_t GetSamplingPeriod (void) const;
+  /// Add the time since the running event was started to its profile
+  void StopTiming (void) const;
+  /// \return whether a newer profiler is taking the events over
+  bool IsSuperseded (void) const;
+  /// Add the profiles counted so far to the newer profiler
+  void HandOver (void);
+  void WriteReport (void);
+
+  static EventProfilingScheduler *s_newest; ///< the profiler created last, if still alive
+
+  Ptr<Scheduler> m_scheduler;
+  std::string m_output;
+  uint32_t m_samplingPeriod;
+  uint32_t m_untilSample;
+  bool m_reportScheduled;
+  mutable Profile *m_running; ///< profile of the timed event, 0 between events
+  mutable Clock::time_point m_started;
+  const std::type_info *m_lastType;
+  Profile *m_lastProfile;
+  std::unordered_map<const std::type_info *, Profile> m_profiles;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (EventProfilingScheduler);
+
+EventProfilingScheduler *EventProfilingScheduler::s_newest = 0;
+
+TypeId
+EventProfilingScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::EventProfilingScheduler")
+    .SetParent<Scheduler> ()
+    .AddConstructor<EventProfilingScheduler> ()
+    .AddAttribute ("Scheduler", "The scheduler that holds the events.",
+                   TypeIdValue (MapScheduler::GetTypeId ()),
+                   MakeTypeIdAccessor (&EventProfilingScheduler::SetScheduler),
+                   MakeTypeIdChecker ())
+    .AddAttribute ("Output", "The report file; the folded stacks go to this name plus .folded.",
+                   StringValue ("events.profile"),
+                   MakeStringAccessor (&EventProfilingScheduler::m_output),
+                   MakeStringChecker ())
+    .AddAttribute ("SamplingPeriod", "Time one in this many events.",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&EventProfilingScheduler::SetSamplingPeriod,
+                                         &EventProfilingScheduler::GetSamplingPeriod),
+                   MakeUintegerChecker<uint32_t> (1))
+  ;
+  return tid;
+}
+
+EventProfilingScheduler::EventProfilingScheduler ()
+  : m_samplingPeriod (1),
+    m_untilSample (1),
+    m_reportScheduled (false),
+    m_running (0),
+    m_lastType (0),
+    m_lastProfile (0)
+{
+  s_newest = this;
+}
+
+EventProfilingScheduler::~EventProfilingScheduler ()
+{
+  if (s_newest == this)
+    {
+      s_newest = 0;
+    }
+}
+
+void
+EventProfilingScheduler::SetScheduler (TypeId tid)
+{
+  ObjectFactory factory;
+  factory.SetTypeId (tid);
+  m_scheduler = factory.Create<Scheduler> ();
+}
+
+void
+EventProfilingScheduler::SetSamplingPeriod (uint32_t period)
+{
+  m_samplingPeriod = period;
+  m_untilSample = period;
+}
+
+uint32_t
+EventProfilingScheduler::GetSamplingPeriod (void) const
+{
+  return m_samplingPeriod;
+}
+
+void
+EventProfilingScheduler::Insert (const Event &ev)
+{
+  m_scheduler->Insert (ev);
+}
+
+bool
+EventProfilingScheduler::IsEmpty (void) const
+{
+  StopTiming ();
+  return m_scheduler->IsEmpty ();
+}
+
+Scheduler::Event
+EventProfilingScheduler::PeekNext (void) const
+{
+  return m_scheduler->PeekNext ();
+}
+
+Scheduler::Event
+EventProfilingScheduler::RemoveNext (void)
+{
+  StopTiming ();
+  if (IsSuperseded ())
+    {
+      // The events are being moved to the newer profiler, not run
+      HandOver ();
+      return m_scheduler->RemoveNext ();
+    }
+  if (!m_reportScheduled)
+    {
+      // Destroy events run before the simulator drains what is left in
+      // the queue, so those events are not counted
+      m_reportScheduled = true;
+      Simulator::ScheduleDestroy (&EventProfilingScheduler::WriteReport, Ptr<EventProfilingScheduler> (this));
+    }
+  Event ev = m_scheduler->RemoveNext ();
+  const std::type_info *type = &typeid (*ev.impl);
+  if (type != m_lastType)
+    {
+      m_lastType = type;
+      m_lastProfile = &m_profiles[type];
+    }
+  ++m_lastProfile->events;
+  if (--m_untilSample == 0)
+    {
+      m_untilSample = m_samplingPeriod;
+      m_running = m_lastProfile;
+      m_started = Clock::now ();
+    }
+  return ev;
+}
+
+void
+EventProfilingScheduler::Remove (const Event &ev)
+{
+  m_scheduler->Remove (ev);
+}
+
+void
+EventProfilingScheduler::StopTiming (void) const
+{
+  if (m_running)
+    {
+      m_running->seconds += std::chrono::duration<double> (Clock::now () - m_started).count () * m_samplingPeriod;
+      m_running = 0;
+    }
+}
+
+bool
+EventProfilingScheduler::IsSuperseded (void) const
+{
+  return s_newest != 0 && s_newest != this;
+}
+
+void
+EventProfilingScheduler::HandOver (void)
+{
+  for (std::unordered_map<const std::type_info *, Profile>::const_iterator i = m_profiles.begin (); i != m_profiles.end (); ++i)
+    {
+      Profile &profile = s_newest->m_profiles[i->first];
+      profile.events += i->second.events;
+      profile.seconds += i->second.seconds;
+    }
+  m_profiles.clear ();
+  m_lastType = 0;
+  m_lastProfile = 0;
+}
+
+void
+EventProfilingScheduler::WriteReport (void)
+{
+  StopTiming ();
+  if (IsSuperseded ())
+    {
+      HandOver ();
+      return;
+    }
+
+  // Event types are keyed by type_info, which can be duplicated across
+  // shared libraries, so merge them by name first
+  struct Row
+  {
+    std::string module;
+    std::string owner;
+    std::string handler;
+    uint64_t events;
+    double seconds;
+
+    bool operator < (Row const &o) const
+    {
+      return seconds > o.seconds;
+    }
+  };
+  std::map<std::string, Row> byName;
+  uint64_t totalEvents = 0;
+  double totalSeconds = 0;
+  for (std::unordered_map<const std::type_info *, Profile>::const_iterator i = m_profiles.begin (); i != m_profiles.end (); ++i)
+    {
+      int status;
+      char *demangled = abi::__cxa_demangle (i->first->name (), 0, 0, &status);
+      std::string name = status == 0 ? demangled : i->first->name ();
+      std::free (demangled);
+
+      Row &row = byName[name];
+      if (row.handler.empty ())
+        {
+          // ns3::MakeEvent<...>(void (ns3::Foo::*)(args), ...)::EventMemberImplN
+          // or ns3::MakeEvent<...>(void (*)(args), ...)::EventFunctionImplN:
+          // the first function parameter is the handler signature
+          row.handler = name;
+          std::string::size_type begin = name.find ("MakeEvent<");
+          if (begin != std::string::npos)
+            {
+              // Skip the template arguments
+              int depth = 0;
+              std::string::size_type end = begin + 9;
+              do
+                {
+                  depth += (name[end] == '<') - (name[end] == '>');
+                  ++end;
+                }
+              while (depth > 0 && end < name.size ());
+              if (end < name.size () && name[end] == '(')
+                {
+                  begin = ++end;
+                  for (; end < name.size (); ++end)
+                    {
+                      char c = name[end];
+                      if ((c == ',' || c == ')') && depth == 0)
+                        {
+                          break;
+                        }
+                      depth += (c == '(' || c == '<') - (c == ')' || c == '>');
+                    }
+                  row.handler = name.substr (begin, end - begin);
+                }
+            }
+          std::string::size_type member = row.handler.find ("::*)");
+          std::string::size_type open = row.handler.rfind ('(', member);
+          row.owner = "function";
+          row.module = "-";
+          if (member != std::string::npos && open != std::string::npos)
+            {
+              row.owner = row.handler.substr (open + 1, member - open - 1);
+              TypeId tid;
+              std::string::size_type inner = row.owner.find ("::", 5);
+              if (TypeId::LookupByNameFailSafe (row.owner, &tid) && !tid.GetGroupName ().empty ())
+                {
+                  row.module = tid.GetGroupName ();
+                }
+              else if (row.owner.compare (0, 5, "ns3::") == 0 && inner != std::string::npos)
+                {
+                  row.module = row.owner.substr (5, inner - 5);
+                }
+            }
+        }
+      row.events += i->second.events;
+      row.seconds += i->second.seconds;
+      totalEvents += i->second.events;
+      totalSeconds += i->second.seconds;
+    }
+
+  std::vector<Row> rows;
+  for (std::map<std::string, Row>::const_iterator i = byName.begin (); i != byName.end (); ++i)
+    {
+      rows.push_back (i->second);
+    }
+  std::sort (rows.begin (), rows.end ());
+
+  std::ofstream report (m_output.c_str ());
+  std::ofstream folded ((m_output + ".folded").c_str ());
+  if (!report || !folded)
+    {
+      NS_FATAL_ERROR ("Cannot write the event profile to " << m_output);
+    }
+  report << "# " << totalEvents << " events, " << totalSeconds * 1e3 << " ms in handlers";
+  if (m_samplingPeriod > 1)
+    {
+      report << ", 1 in " << m_samplingPeriod << " events timed";
+    }
+  report << "\n" << std::setw (12) << "Time(ms)" << std::setw (8) << "%" << std::setw (12) << "Events"
+         << std::setw (12) << "ns/event" << "  " << std::left << std::setw (12) << "Module" << std::right << "  Handler\n";
+  report << std::fixed;
+  for (std::vector<Row>::const_iterator r = rows.begin (); r != rows.end (); ++r)
+    {
+      report << std::setprecision (3) << std::setw (12) << r->seconds * 1e3
+             << std::setprecision (1) << std::setw (8) << (totalSeconds > 0 ? r->seconds * 100 / totalSeconds : 0)
+             << std::setw (12) << r->events
+             << std::setprecision (0) << std::setw (12) << r->seconds * 1e9 / r->events
+             << "  " << std::left << std::setw (12) << r->module << std::right << "  " << r->handler << "\n";
+      folded << r->module << ";" << r->owner << ";" << r->handler << " " << std::llround (r->seconds * 1e6) << "\n";
+    }
+}
+
+/**
+ * Make every simulator created from now on profile its events with an
+ * EventProfilingScheduler around the current SchedulerType, and write
+ * the report to output.
+ */
+static void
+EnableEventProfiling (std::string output)
+{
+  TypeIdValue current;
+  GlobalValue::GetValueByName ("SchedulerType", current);
+  if (current.Get () != EventProfilingScheduler::GetTypeId ())
+    {
+      Config::SetDefault ("ns3::EventProfilingScheduler::Scheduler", current);
+      GlobalValue::Bind ("SchedulerType", TypeIdValue (EventProfilingScheduler::GetTypeId ()));
+    }
+  Config::SetDefault ("ns3::EventProfilingScheduler::Output", StringValue (output));
+}
+
+} // namespace ns3
+
+#endif /* EVENT_PROFILER_H */
@@ -0,0 +1,132 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Sums the binary FlowMonitor files written with --flowmonFormat=binary
+// (see flowmon-binary.h) over many runs, per source, destination,
+// protocol and destination port:
+//
+//   ./waf --run "flowmon-aggregate run1/flowmon.bin run2/flowmon.bin ..."
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "flowmon-binary.h"
+
+#include <iostream>
+#include <map>
+
+using namespace ns3;
+
+struct FlowKey
+{
+  uint32_t source;
+  uint32_t destination;
+  uint8_t protocol;
+  uint16_t destinationPort;
+
+  bool operator < (const FlowKey &o) const
+  {
+    if (source != o.source)
+      {
+        return source < o.source;
+      }
+    if (destination != o.destination)
+      {
+        return destination < o.destination;
+      }
+    if (protocol != o.protocol)
+      {
+        return protocol < o.protocol;
+      }
+    return destinationPort < o.destinationPort;
+  }
+};
+
+struct FlowTotals
+{
+  uint32_t runs;
+  uint64_t txPackets;
+  uint64_t rxPackets;
+  uint64_t lostPackets;
+  uint64_t rxBytes;
+  int64_t delaySum;
+  double throughputSum;
+};
+
+int
+main (int argc, char *argv[])
+{
+  if (argc < 2)
+    {
+      std::cerr << "usage: flowmon-aggregate FILE..." << std::endl;
+      return 1;
+    }
+
+  std::map<FlowKey, FlowTotals> totals;
+  uint32_t files = 0;
+  FlowmonBinaryFile file;
+  for (int a = 1; a < argc; ++a)
+    {
+      if (!file.Open (argv[a]))
+        {
+          std::cerr << file.GetError () << ", skipped" << std::endl;
+          continue;
+        }
+      ++files;
+      const FlowmonFlowRecord *flows = file.GetFlows ();
+      for (uint32_t i = 0; i < file.GetFlowCount (); ++i)
+        {
+          const FlowmonFlowRecord &r = flows[i];
+          FlowKey key = { r.sourceAddress, r.destinationAddress, r.protocol, r.destinationPort };
+          std::map<FlowKey, FlowTotals>::iterator it = totals.find (key);
+          if (it == totals.end ())
+            {
+              FlowTotals zero = { 0, 0, 0, 0, 0, 0, 0 };
+              it = totals.insert (std::make_pair (key, zero)).first;
+            }
+          FlowTotals &t = it->second;
+          ++t.runs;
+          t.txPackets += r.txPackets;
+          t.rxPackets += r.rxPackets;
+          t.lostPackets += r.lostPackets;
+          t.rxBytes += r.rxBytes;
+          t.delaySum += r.delaySum;
+          if (r.timeLastRxPacket > r.timeFirstTxPacket)
+            {
+              t.throughputSum += r.rxBytes * 8.0 / ((r.timeLastRxPacket - r.timeFirstTxPacket) / 1e9) / 1e6;
+            }
+        }
+    }
+  file.Close ();
+
+  std::cout << files << " files, " << totals.size () << " flows" << std::endl;
+  for (std::map<FlowKey, FlowTotals>::const_iterator it = totals.begin (); it != totals.end (); ++it)
+    {
+      const FlowTotals &t = it->second;
+      std::cout << Ipv4Address (it->first.source) << " -> " << Ipv4Address (it->first.destination)
+                << " proto " << uint32_t (it->first.protocol) << " port " << it->first.destinationPort << "\n";
+      std::cout << "  Runs:            " << t.runs << "\n";
+      std::cout << "  Tx Packets:      " << t.txPackets << "\n";
+      std::cout << "  Rx Packets:      " << t.rxPackets << "\n";
+      std::cout << "  Lost Packets:    " << t.lostPackets << "\n";
+      std::cout << "  Rx Bytes:        " << t.rxBytes << "\n";
+      if (t.rxPackets > 0)
+        {
+          std::cout << "  Mean delay:      " << t.delaySum / 1e6 / t.rxPackets << " ms\n";
+        }
+      std::cout << "  Mean throughput: " << t.throughputSum / t.runs << " Mbps\n";
+    }
+  return 0;
+}
@@ -0,0 +1,294 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Compact binary alternative to FlowMonitor::SerializeToXmlFile and a
+// memory-mapped reader for it.
+//
+// File layout (host byte order, every field naturally aligned):
+//
+//   FlowmonFileHeader
+//   FlowmonFlowRecord  x header.flowCount,  at header.flowOffset
+//   FlowmonProbeRecord x header.probeRecordCount, at header.probeOffset
+//
+// Times are in nanoseconds. Histograms and the per drop reason
+// counters are not part of version 1; use the XML output for those.
+
+#ifndef FLOWMON_BINARY_H
+#define FLOWMON_BINARY_H
+
+#include "ns3/flow-monitor.h"
+#include "ns3/flow-probe.h"
+#include "ns3/ipv4-flow-classifier.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static const char FLOWMON_BINARY_MAGIC[8] = { 'N', 'S', '3', 'F', 'M', 'O', 'N', 0 };
+static const uint32_t FLOWMON_BINARY_VERSION = 1;
+
+struct FlowmonFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t flowCount;
+  uint32_t probeCount;
+  uint32_t probeRecordCount;
+  uint64_t flowOffset;
+  uint64_t probeOffset;
+};
+
+/// FlowMonitor::FlowStats of one flow plus its Ipv4FlowClassifier five-tuple
+struct FlowmonFlowRecord
+{
+  uint32_t flowId;
+  uint32_t sourceAddress;
+  uint32_t destinationAddress;
+  uint16_t sourcePort;
+  uint16_t destinationPort;
+  uint8_t protocol;
+  uint8_t pad[7];
+  int64_t timeFirstTxPacket;
+  int64_t timeFirstRxPacket;
+  int64_t timeLastTxPacket;
+  int64_t timeLastRxPacket;
+  int64_t delaySum;
+  int64_t jitterSum;
+  int64_t lastDelay;
+  uint64_t txBytes;
+  uint64_t rxBytes;
+  uint32_t txPackets;
+  uint32_t rxPackets;
+  uint32_t lostPackets;
+  uint32_t timesForwarded;
+};
+
+/// FlowProbe::FlowStats of one flow as seen by one probe
+struct FlowmonProbeRecord
+{
+  uint32_t probeId;
+  uint32_t flowId;
+  uint32_t packets;
+  uint32_t pad;
+  uint64_t bytes;
+  int64_t delayFromFirstProbeSum;
+};
+
+/**
+ * Write the stats of monitor, the five-tuples of classifier and the
+ * per probe stats to filename in the format above.
+ *
+ * \return false if the file could not be written
+ */
+inline bool
+SerializeToBinaryFile (ns3::Ptr<ns3::FlowMonitor> monitor,
+                       ns3::Ptr<ns3::Ipv4FlowClassifier> classifier,
+                       std::string filename)
+{
+  monitor->CheckForLostPackets ();
+  const ns3::FlowMonitor::FlowStatsContainer &stats = monitor->GetFlowStats ();
+  const std::vector<ns3::Ptr<ns3::FlowProbe> > &probes = monitor->GetAllProbes ();
+
+  std::vector<FlowmonFlowRecord> flows;
+  flows.reserve (stats.size ());
+  for (ns3::FlowMonitor::FlowStatsContainerCI i = stats.begin (); i != stats.end (); ++i)
+    {
+      FlowmonFlowRecord r;
+      std::memset (&r, 0, sizeof (r));
+      ns3::Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow (i->first);
+      r.flowId = i->first;
+      r.sourceAddress = t.sourceAddress.Get ();
+      r.destinationAddress = t.destinationAddress.Get ();
+      r.sourcePort = t.sourcePort;
+      r.destinationPort = t.destinationPort;
+      r.protocol = t.protocol;
+      r.timeFirstTxPacket = i->second.timeFirstTxPacket.GetNanoSeconds ();
+      r.timeFirstRxPacket = i->second.timeFirstRxPacket.GetNanoSeconds ();
+      r.timeLastTxPacket = i->second.timeLastTxPacket.GetNanoSeconds ();
+      r.timeLastRxPacket = i->second.timeLastRxPacket.GetNanoSeconds ();
+      r.delaySum = i->second.delaySum.GetNanoSeconds ();
+      r.jitterSum = i->second.jitterSum.GetNanoSeconds ();
+      r.lastDelay = i->second.lastDelay.GetNanoSeconds ();
+      r.txBytes = i->second.txBytes;
+      r.rxBytes = i->second.rxBytes;
+      r.txPackets = i->second.txPackets;
+      r.rxPackets = i->second.rxPackets;
+      r.lostPackets = i->second.lostPackets;
+      r.timesForwarded = i->second.timesForwarded;
+      flows.push_back (r);
+    }
+
+  std::vector<FlowmonProbeRecord> probeRecords;
+  for (uint32_t p = 0; p < probes.size (); ++p)
+    {
+      ns3::FlowProbe::Stats probeStats = probes[p]->GetStats ();
+      for (ns3::FlowProbe::Stats::const_iterator i = probeStats.begin (); i != probeStats.end (); ++i)
+        {
+          FlowmonProbeRecord r;
+          std::memset (&r, 0, sizeof (r));
+          r.probeId = p;
+          r.flowId = i->first;
+          r.packets = i->second.packets;
+          r.bytes = i->second.bytes;
+          r.delayFromFirstProbeSum = i->second.delayFromFirstProbeSum.GetNanoSeconds ();
+          probeRecords.push_back (r);
+        }
+    }
+
+  FlowmonFileHeader header;
+  std::memset (&header, 0, sizeof (header));
+  std::memcpy (header.magic, FLOWMON_BINARY_MAGIC, sizeof (header.magic));
+  header.version = FLOWMON_BINARY_VERSION;
+  header.flowCount = flows.size ();
+  header.probeCount = probes.size ();
+  header.probeRecordCount = probeRecords.size ();
+  header.flowOffset = sizeof (header);
+  header.probeOffset = header.flowOffset + flows.size () * sizeof (FlowmonFlowRecord);
+
+  FILE *f = std::fopen (filename.c_str (), "wb");
+  if (f == 0)
+    {
+      return false;
+    }
+  bool ok = std::fwrite (&header, sizeof (header), 1, f) == 1;
+  if (ok && !flows.empty ())
+    {
+      ok = std::fwrite (&flows[0], sizeof (FlowmonFlowRecord), flows.size (), f) == flows.size ();
+    }
+  if (ok && !probeRecords.empty ())
+    {
+      ok = std::fwrite (&probeRecords[0], sizeof (FlowmonProbeRecord), probeRecords.size (), f) == probeRecords.size ();
+    }
+  return std::fclose (f) == 0 && ok;
+}
+
+/**
+ * Read-only, memory-mapped view of a file written by
+ * SerializeToBinaryFile. The records are used in place; nothing is
+ * parsed or copied.
+ */
+class FlowmonBinaryFile
+{
+public:
+  FlowmonBinaryFile ()
+    : m_data (0),
+      m_size (0)
+  {
+  }
+  ~FlowmonBinaryFile ()
+  {
+    Close ();
+  }
+
+  /// \return false, with GetError () set, if filename is not a valid file
+  bool Open (std::string filename)
+  {
+    Close ();
+    int fd = open (filename.c_str (), O_RDONLY);
+    if (fd < 0)
+      {
+        return Fail ("cannot open " + filename);
+      }
+    struct stat st;
+    if (fstat (fd, &st) != 0 || st.st_size < (off_t) sizeof (FlowmonFileHeader))
+      {
+        close (fd);
+        return Fail (filename + " is too short");
+      }
+    void *data = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (data == MAP_FAILED)
+      {
+        return Fail ("cannot map " + filename);
+      }
+    m_data = static_cast<const char *> (data);
+    m_size = st.st_size;
+
+    const FlowmonFileHeader *h = GetHeader ();
+    if (std::memcmp (h->magic, FLOWMON_BINARY_MAGIC, sizeof (h->magic)) != 0)
+      {
+        Close ();
+        return Fail (filename + " is not a binary FlowMonitor file");
+      }
+    if (h->version != FLOWMON_BINARY_VERSION)
+      {
+        Close ();
+        return Fail (filename + " has an unsupported version");
+      }
+    if (h->flowOffset + uint64_t (h->flowCount) * sizeof (FlowmonFlowRecord) > m_size
+        || h->probeOffset + uint64_t (h->probeRecordCount) * sizeof (FlowmonProbeRecord) > m_size)
+      {
+        Close ();
+        return Fail (filename + " is truncated");
+      }
+    return true;
+  }
+  void Close (void)
+  {
+    if (m_data != 0)
+      {
+        munmap (const_cast<char *> (m_data), m_size);
+        m_data = 0;
+        m_size = 0;
+      }
+  }
+
+  std::string GetError (void) const
+  {
+    return m_error;
+  }
+  const FlowmonFileHeader *GetHeader (void) const
+  {
+    return reinterpret_cast<const FlowmonFileHeader *> (m_data);
+  }
+  uint32_t GetFlowCount (void) const
+  {
+    return GetHeader ()->flowCount;
+  }
+  const FlowmonFlowRecord *GetFlows (void) const
+  {
+    return reinterpret_cast<const FlowmonFlowRecord *> (m_data + GetHeader ()->flowOffset);
+  }
+  uint32_t GetProbeRecordCount (void) const
+  {
+    return GetHeader ()->probeRecordCount;
+  }
+  const FlowmonProbeRecord *GetProbeRecords (void) const
+  {
+    return reinterpret_cast<const FlowmonProbeRecord *> (m_data + GetHeader ()->probeOffset);
+  }
+
+private:
+  FlowmonBinaryFile (const FlowmonBinaryFile &);
+  FlowmonBinaryFile &operator = (const FlowmonBinaryFile &);
+
+  bool Fail (std::string error)
+  {
+    m_error = error;
+    return false;
+  }
+
+  const char *m_data;
+  uint64_t m_size;
+  std::string m_error;
+};
+
+#endif /* FLOWMON_BINARY_H */
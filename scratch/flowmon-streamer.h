@@ -0,0 +1,122 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Per interval FlowMonitor export, for the --flowmonInterval mode of
+// third.cc and lab1_a.cc.
+//
+// File layout: one "# time flowId ..." column header when the file is
+// created, then one line per flow and interval, appended by every run.
+
+#ifndef FLOWMON_STREAMER_H
+#define FLOWMON_STREAMER_H
+
+#include "ns3/core-module.h"
+#include "ns3/flow-monitor.h"
+#include "ns3/ipv4-flow-classifier.h"
+
+#include <fstream>
+#include <string>
+
+namespace ns3 {
+
+/**
+ * Appends, every interval, each flow's FlowMonitor counters for the
+ * interval that just ended, so a long run can be followed as a time
+ * series instead of one end-of-run dump. The monitor's statistics,
+ * histograms included, are reset after every export, so what the
+ * monitor holds is bounded by the number of flows rather than growing
+ * with the length of the run; the end-of-run totals are then only in
+ * the stream.
+ */
+class FlowMonitorStreamer
+{
+public:
+  FlowMonitorStreamer (Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier,
+                       std::string filename, Time interval);
+  /// Write the interval ending now; call once more after the run for the last one
+  void Export (void);
+
+private:
+  void Tick (void);
+
+  Ptr<FlowMonitor> m_monitor;
+  Ptr<Ipv4FlowClassifier> m_classifier;
+  Time m_interval;
+  Time m_last;
+  std::ofstream m_out;
+};
+
+FlowMonitorStreamer::FlowMonitorStreamer (Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier,
+                                          std::string filename, Time interval)
+  : m_monitor (monitor),
+    m_classifier (classifier),
+    m_interval (interval),
+    m_last (Seconds (-1))
+{
+  std::ifstream existing (filename.c_str (), std::ios::binary | std::ios::ate);
+  bool empty = !existing || existing.tellg () == 0;
+  existing.close ();
+  m_out.open (filename.c_str (), std::ios::app);
+  if (!m_out)
+    {
+      NS_FATAL_ERROR ("Cannot open " << filename);
+    }
+  if (empty)
+    {
+      m_out << "# time flowId src dst txPackets rxPackets txBytes rxBytes lostPackets delaySum jitterSum\n";
+    }
+  Simulator::Schedule (m_interval, &FlowMonitorStreamer::Tick, this);
+}
+
+void
+FlowMonitorStreamer::Tick (void)
+{
+  Export ();
+  Simulator::Schedule (m_interval, &FlowMonitorStreamer::Tick, this);
+}
+
+void
+FlowMonitorStreamer::Export (void)
+{
+  Time now = Simulator::Now ();
+  if (now == m_last)
+    {
+      return;
+    }
+  m_last = now;
+
+  m_monitor->CheckForLostPackets ();
+  const FlowMonitor::FlowStatsContainer &stats = m_monitor->GetFlowStats ();
+  for (FlowMonitor::FlowStatsContainerCI i = stats.begin (); i != stats.end (); ++i)
+    {
+      FlowMonitor::FlowStats const &s = i->second;
+      Ipv4FlowClassifier::FiveTuple t = m_classifier->FindFlow (i->first);
+      m_out << now.GetSeconds () << " " << i->first << " "
+            << t.sourceAddress << ":" << t.sourcePort << " "
+            << t.destinationAddress << ":" << t.destinationPort << " "
+            << s.txPackets << " " << s.rxPackets << " "
+            << s.txBytes << " " << s.rxBytes << " "
+            << s.lostPackets << " "
+            << s.delaySum.GetSeconds () << " "
+            << s.jitterSum.GetSeconds () << "\n";
+    }
+  m_out.flush ();
+  m_monitor->ResetAllStats ();
+}
+
+} // namespace ns3
+
+#endif /* FLOWMON_STREAMER_H */
@@ -0,0 +1,326 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Spectrum channel that buckets the PHYs into a uniform grid and only
+// visits the receivers within range of the sender, for the
+// --gridChannel mode of 4-range.cc.
+
+#ifndef GRID_SPECTRUM_CHANNEL_H
+#define GRID_SPECTRUM_CHANNEL_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/angles.h"
+#include "ns3/antenna-model.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/single-model-spectrum-channel.h"
+#include "ns3/spectrum-phy.h"
+#include "ns3/spectrum-signal-parameters.h"
+#include "ns3/spectrum-value.h"
+
+#include <cmath>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief A SingleModelSpectrumChannel that skips the PHYs out of range
+ * without looking at them
+ *
+ * The PHYs are bucketed by their x and y position into square cells
+ * as wide as MaxRange, so every receiver within MaxRange of a sender
+ * is in the sender's cell or one of its eight neighbours. A frame only
+ * visits the PHYs of those nine cells, and those of them closer than
+ * MaxRange get a reception, so its cost is proportional to the PHYs
+ * around the sender rather than to all PHYs on the channel. A
+ * CourseChange of any PHY's mobility model, or a PHY being added,
+ * drops the grid, which is rebuilt by the next frame. Models with a
+ * non-zero velocity move without firing CourseChange, so PHYs that
+ * have one are kept out of the grid and visited by every frame, as
+ * are PHYs without a mobility model.
+ *
+ * MaxRange must be at least the distance at which the propagation loss
+ * model stops delivering anything; with its default of 0 it is read
+ * from the model, which must then be a RangePropagationLossModel. The
+ * PathLoss and Gain traces are not fired.
+ */
+class GridSpectrumChannel : public SingleModelSpectrumChannel
+{
+public:
+  static TypeId GetTypeId (void);
+  GridSpectrumChannel ();
+  virtual ~GridSpectrumChannel ();
+
+  virtual void AddRx (Ptr<SpectrumPhy> phy);
+  virtual void StartTx (Ptr<SpectrumSignalParameters> params);
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  struct Member
+  {
+    Ptr<SpectrumPhy> phy;
+    Ptr<MobilityModel> mobility;
+  };
+  typedef std::vector<Member> MemberList;
+
+  /// Bucket every PHY into m_cells, m_moving or m_unplaced
+  void Build (void);
+  /// \return the key of the cell with indices x and y
+  static uint64_t GetKey (int64_t x, int64_t y);
+  /// \return the index of the cell coordinate c falls in
+  int64_t GetIndex (double c) const;
+  void CourseChanged (Ptr<const MobilityModel> m);
+  /// Schedule the reception of params by rx, unless it is out of range
+  void Deliver (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> txMobility,
+                Vector const &txPosition, Member const &rx);
+
+  double m_maxRange;
+  double m_cellSize;
+  bool m_valid;
+  std::vector<Ptr<SpectrumPhy> > m_phys;
+  std::unordered_map<uint64_t, MemberList> m_cells;
+  MemberList m_moving;    ///< PHYs with a velocity
+  MemberList m_unplaced;  ///< PHYs without a mobility model
+  std::set<const MobilityModel *> m_watched;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (GridSpectrumChannel);
+
+TypeId
+GridSpectrumChannel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::GridSpectrumChannel")
+    .SetParent<SingleModelSpectrumChannel> ()
+    .SetGroupName ("Spectrum")
+    .AddConstructor<GridSpectrumChannel> ()
+    .AddAttribute ("MaxRange", "Receivers further than this (m) from the sender get no reception; "
+                   "0 takes the MaxRange of the RangePropagationLossModel in use.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&GridSpectrumChannel::m_maxRange),
+                   MakeDoubleChecker<double> (0.0))
+  ;
+  return tid;
+}
+
+GridSpectrumChannel::GridSpectrumChannel ()
+  : m_maxRange (0.0),
+    m_cellSize (0.0),
+    m_valid (false)
+{
+}
+
+GridSpectrumChannel::~GridSpectrumChannel ()
+{
+}
+
+void
+GridSpectrumChannel::DoDispose (void)
+{
+  m_phys.clear ();
+  m_cells.clear ();
+  m_moving.clear ();
+  m_unplaced.clear ();
+  SingleModelSpectrumChannel::DoDispose ();
+}
+
+void
+GridSpectrumChannel::AddRx (Ptr<SpectrumPhy> phy)
+{
+  SingleModelSpectrumChannel::AddRx (phy);
+  m_phys.push_back (phy);
+  m_valid = false;
+}
+
+void
+GridSpectrumChannel::CourseChanged (Ptr<const MobilityModel> m)
+{
+  m_valid = false;
+}
+
+uint64_t
+GridSpectrumChannel::GetKey (int64_t x, int64_t y)
+{
+  return (uint64_t (uint32_t (x)) << 32) | uint32_t (y);
+}
+
+int64_t
+GridSpectrumChannel::GetIndex (double c) const
+{
+  return int64_t (std::floor (c / m_cellSize));
+}
+
+void
+GridSpectrumChannel::Build (void)
+{
+  if (m_maxRange > 0)
+    {
+      m_cellSize = m_maxRange;
+    }
+  else
+    {
+      Ptr<RangePropagationLossModel> range = DynamicCast<RangePropagationLossModel> (m_propagationLoss);
+      if (range == 0)
+        {
+          NS_FATAL_ERROR ("GridSpectrumChannel needs MaxRange unless its loss model is a RangePropagationLossModel");
+        }
+      DoubleValue maxRange;
+      range->GetAttribute ("MaxRange", maxRange);
+      m_cellSize = maxRange.Get ();
+    }
+  if (m_cellSize <= 0)
+    {
+      NS_FATAL_ERROR ("GridSpectrumChannel needs a positive MaxRange");
+    }
+
+  m_cells.clear ();
+  m_moving.clear ();
+  m_unplaced.clear ();
+  for (std::vector<Ptr<SpectrumPhy> >::const_iterator i = m_phys.begin (); i != m_phys.end (); ++i)
+    {
+      Member member;
+      member.phy = *i;
+      member.mobility = (*i)->GetMobility ();
+      if (member.mobility == 0)
+        {
+          m_unplaced.push_back (member);
+          continue;
+        }
+      if (m_watched.insert (PeekPointer (member.mobility)).second)
+        {
+          member.mobility->TraceConnectWithoutContext ("CourseChange", MakeCallback (&GridSpectrumChannel::CourseChanged, this));
+        }
+      Vector v = member.mobility->GetVelocity ();
+      if (v.x != 0 || v.y != 0 || v.z != 0)
+        {
+          m_moving.push_back (member);
+          continue;
+        }
+      Vector p = member.mobility->GetPosition ();
+      m_cells[GetKey (GetIndex (p.x), GetIndex (p.y))].push_back (member);
+    }
+  m_valid = true;
+}
+
+void
+GridSpectrumChannel::Deliver (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> txMobility,
+                              Vector const &txPosition, Member const &rx)
+{
+  if (rx.phy == txParams->txPhy)
+    {
+      return;
+    }
+  Vector rxPosition;
+  if (rx.mobility)
+    {
+      rxPosition = rx.mobility->GetPosition ();
+      if (CalculateDistance (txPosition, rxPosition) > m_cellSize)
+        {
+          return;
+        }
+    }
+  Time delay = Seconds (0);
+  Ptr<SpectrumSignalParameters> rxParams = txParams->Copy ();
+  if (rx.mobility)
+    {
+      double gainDb = 0;
+      if (txParams->txAntenna)
+        {
+          gainDb += txParams->txAntenna->GetGainDb (Angles (rxPosition, txPosition));
+        }
+      if (rx.phy->GetRxAntenna ())
+        {
+          gainDb += rx.phy->GetRxAntenna ()->GetGainDb (Angles (txPosition, rxPosition));
+        }
+      if (m_propagationLoss)
+        {
+          gainDb += m_propagationLoss->CalcRxPower (0, txMobility, rx.mobility);
+        }
+      *(rxParams->psd) *= std::pow (10.0, gainDb / 10.0);
+      if (m_spectrumPropagationLoss)
+        {
+          rxParams->psd = m_spectrumPropagationLoss->CalcRxPowerSpectralDensity (rxParams->psd, txMobility, rx.mobility);
+        }
+      if (m_propagationDelay)
+        {
+          delay = m_propagationDelay->GetDelay (txMobility, rx.mobility);
+        }
+    }
+  Ptr<NetDevice> device = rx.phy->GetDevice ();
+  if (device && device->GetNode ())
+    {
+      Simulator::ScheduleWithContext (device->GetNode ()->GetId (), delay, &SpectrumPhy::StartRx, rx.phy, rxParams);
+    }
+  else
+    {
+      Simulator::Schedule (delay, &SpectrumPhy::StartRx, rx.phy, rxParams);
+    }
+}
+
+void
+GridSpectrumChannel::StartTx (Ptr<SpectrumSignalParameters> txParams)
+{
+  NS_ASSERT_MSG (txParams->psd, "NULL txPsd");
+  NS_ASSERT_MSG (txParams->txPhy, "NULL txPhy");
+
+  Ptr<MobilityModel> txMobility = txParams->txPhy->GetMobility ();
+  if (txMobility == 0)
+    {
+      // Without a position every PHY is a candidate
+      SingleModelSpectrumChannel::StartTx (txParams);
+      return;
+    }
+  if (!m_valid)
+    {
+      Build ();
+    }
+
+  Vector p = txMobility->GetPosition ();
+  int64_t x = GetIndex (p.x);
+  int64_t y = GetIndex (p.y);
+  for (int64_t i = x - 1; i <= x + 1; ++i)
+    {
+      for (int64_t j = y - 1; j <= y + 1; ++j)
+        {
+          std::unordered_map<uint64_t, MemberList>::const_iterator cell = m_cells.find (GetKey (i, j));
+          if (cell == m_cells.end ())
+            {
+              continue;
+            }
+          for (MemberList::const_iterator rx = cell->second.begin (); rx != cell->second.end (); ++rx)
+            {
+              Deliver (txParams, txMobility, p, *rx);
+            }
+        }
+    }
+  for (MemberList::const_iterator rx = m_moving.begin (); rx != m_moving.end (); ++rx)
+    {
+      Deliver (txParams, txMobility, p, *rx);
+    }
+  for (MemberList::const_iterator rx = m_unplaced.begin (); rx != m_unplaced.end (); ++rx)
+    {
+      Deliver (txParams, txMobility, p, *rx);
+    }
+}
+
+} // namespace ns3
+
+#endif /* GRID_SPECTRUM_CHANNEL_H */
@@ -28,6 +28,8 @@
 #include "ns3/netanim-module.h"
 #include "ns3/flow-monitor.h"
 #include "ns3/flow-monitor-helper.h"
+#include "ns3/ipv4-flow-classifier.h"
+#include "flowmon-streamer.h"
 #include<stdlib.h>
 #include<time.h>
 
@@ -48,6 +50,10 @@ bool verbose = true;
   CommandLine cmd;
   cmd.AddValue ("nWifi", "Number of wifi STA devices", nWifi);
   cmd.AddValue ("verbose", "Tell echo applications to log if true", verbose);
+  double flowmonInterval = 0;
+  std::string flowmonStream = "flowmon-stream.txt";
+  cmd.AddValue ("flowmonInterval", "Append the per flow FlowMonitor counters every this many seconds and reset them, instead of writing the end-of-run dump (0 = off)", flowmonInterval);
+  cmd.AddValue ("flowmonStream", "File the per interval FlowMonitor counters are appended to", flowmonStream);
   cmd.Parse (argc, argv);
 
 if (nWifi > 18)
@@ -163,13 +169,27 @@ if(s!=d)
   Ptr<FlowMonitor> flowmonitor;
   FlowMonitorHelper flowhelper;
   flowmonitor=flowhelper.InstallAll();
+  FlowMonitorStreamer *streamer = 0;
+  if (flowmonInterval > 0)
+    {
+      streamer = new FlowMonitorStreamer (flowmonitor, DynamicCast<Ipv4FlowClassifier> (flowhelper.GetClassifier ()),
+                                          flowmonStream, Seconds (flowmonInterval));
+    }
 
   Simulator::Stop (Seconds (10.0));
 
   AnimationInterface anim("lab1_a.xml");
 
   Simulator::Run ();
-  flowmonitor->SerializeToXmlFile("flowmon.xml",true,true);
+  if (streamer)
+    {
+      streamer->Export ();
+    }
+  else
+    {
+      flowmonitor->SerializeToXmlFile("flowmon.xml",true,true);
+    }
   Simulator::Destroy ();
+  delete streamer;
   return 0;
 }
@@ -0,0 +1,261 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Progress of a running simulation in a POSIX shared memory segment,
+// written by the simulation (see LiveStatsPublisher in aodv_lab.cc) and
+// read by scratch/stats-watch from another process.
+//
+// The segment is a LiveStatsSegment. Its snapshot is guarded by a
+// sequence lock: the writer makes the sequence odd, updates the
+// snapshot and makes it even again, and a reader retries until it has
+// copied the snapshot between two reads of the same even sequence. The
+// writer never waits for a reader.
+
+#ifndef LIVE_STATS_H
+#define LIVE_STATS_H
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char LIVE_STATS_MAGIC[8] = { 'N', 'S', '3', 'L', 'I', 'V', 'E', 0 };
+static const uint32_t LIVE_STATS_VERSION = 1;
+static const uint32_t LIVE_STATS_MAX_FLOWS = 64;
+
+/// FlowMonitor counters of one flow
+struct LiveStatsFlow
+{
+  uint32_t source;
+  uint32_t destination;
+  uint16_t sourcePort;
+  uint16_t destinationPort;
+  uint8_t protocol;
+  uint8_t pad[3];
+  uint64_t txPackets;
+  uint64_t rxPackets;
+  uint64_t txBytes;
+  uint64_t rxBytes;
+};
+
+struct LiveStatsSnapshot
+{
+  int64_t simTime;          //!< nanoseconds
+  double wallTime;          //!< seconds since the segment was created
+  uint64_t events;          //!< events taken off the event queue so far
+  double eventsPerSecond;   //!< over the last publishing interval
+  uint64_t queueSize;       //!< events in the event queue, cancelled ones included
+  uint64_t residentBytes;
+  uint32_t finished;        //!< 1 once the simulation has returned from Run
+  uint32_t flowCount;       //!< flows[] in use; flows beyond LIVE_STATS_MAX_FLOWS are left out
+  uint32_t totalFlows;
+  uint32_t pad;
+  LiveStatsFlow flows[LIVE_STATS_MAX_FLOWS];
+};
+
+struct LiveStatsSegment
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t pid;                     //!< of the writer
+  std::atomic<uint64_t> sequence;   //!< odd while the snapshot is written
+  LiveStatsSnapshot snapshot;
+};
+
+/// \return the resident set size of the calling process, 0 if unknown
+inline uint64_t
+GetResidentBytes (void)
+{
+  FILE *f = std::fopen ("/proc/self/statm", "r");
+  if (f == 0)
+    {
+      return 0;
+    }
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  int n = std::fscanf (f, "%lu %lu", &size, &resident);
+  std::fclose (f);
+  return n == 2 ? uint64_t (resident) * sysconf (_SC_PAGESIZE) : 0;
+}
+
+/**
+ * Creates a segment and publishes snapshots to it. The segment is
+ * unlinked again by Close, after the final snapshot, so a reader that
+ * still has it mapped sees that snapshot while new readers do not find
+ * a stale segment.
+ */
+class LiveStatsWriter
+{
+public:
+  LiveStatsWriter ()
+    : m_segment (0)
+  {
+  }
+  ~LiveStatsWriter ()
+  {
+    Close ();
+  }
+
+  /// \param name shm_open name, starting with '/'
+  /// \return false if the segment could not be created
+  bool Open (std::string name)
+  {
+    Close ();
+    int fd = shm_open (name.c_str (), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+      {
+        return false;
+      }
+    if (ftruncate (fd, sizeof (LiveStatsSegment)) != 0)
+      {
+        close (fd);
+        shm_unlink (name.c_str ());
+        return false;
+      }
+    void *data = mmap (0, sizeof (LiveStatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (data == MAP_FAILED)
+      {
+        shm_unlink (name.c_str ());
+        return false;
+      }
+    m_name = name;
+    m_segment = static_cast<LiveStatsSegment *> (data);
+    std::memcpy (m_segment->magic, LIVE_STATS_MAGIC, sizeof (m_segment->magic));
+    m_segment->version = LIVE_STATS_VERSION;
+    m_segment->pid = getpid ();
+    return true;
+  }
+  void Close (void)
+  {
+    if (m_segment != 0)
+      {
+        munmap (m_segment, sizeof (LiveStatsSegment));
+        shm_unlink (m_name.c_str ());
+        m_segment = 0;
+      }
+  }
+  void Publish (LiveStatsSnapshot const &snapshot)
+  {
+    uint64_t sequence = m_segment->sequence.load (std::memory_order_relaxed);
+    m_segment->sequence.store (sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+    std::memcpy (&m_segment->snapshot, &snapshot, sizeof (snapshot));
+    m_segment->sequence.store (sequence + 2, std::memory_order_release);
+  }
+
+private:
+  LiveStatsWriter (const LiveStatsWriter &);
+  LiveStatsWriter &operator = (const LiveStatsWriter &);
+
+  std::string m_name;
+  LiveStatsSegment *m_segment;
+};
+
+/// Read-only view of a segment created by LiveStatsWriter
+class LiveStatsReader
+{
+public:
+  LiveStatsReader ()
+    : m_segment (0)
+  {
+  }
+  ~LiveStatsReader ()
+  {
+    Close ();
+  }
+
+  /// \return false if name is not a live stats segment
+  bool Open (std::string name)
+  {
+    Close ();
+    int fd = shm_open (name.c_str (), O_RDONLY, 0);
+    if (fd < 0)
+      {
+        return false;
+      }
+    struct stat st;
+    if (fstat (fd, &st) != 0 || st.st_size < (off_t) sizeof (LiveStatsSegment))
+      {
+        close (fd);
+        return false;
+      }
+    void *data = mmap (0, sizeof (LiveStatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (data == MAP_FAILED)
+      {
+        return false;
+      }
+    m_segment = static_cast<const LiveStatsSegment *> (data);
+    if (std::memcmp (m_segment->magic, LIVE_STATS_MAGIC, sizeof (m_segment->magic)) != 0
+        || m_segment->version != LIVE_STATS_VERSION)
+      {
+        Close ();
+        return false;
+      }
+    return true;
+  }
+  void Close (void)
+  {
+    if (m_segment != 0)
+      {
+        munmap (const_cast<LiveStatsSegment *> (m_segment), sizeof (LiveStatsSegment));
+        m_segment = 0;
+      }
+  }
+  uint32_t GetPid (void) const
+  {
+    return m_segment->pid;
+  }
+  /**
+   * Copy a consistent snapshot.
+   *
+   * \return the sequence it was published with; 0 if nothing has been
+   * published yet
+   */
+  uint64_t Read (LiveStatsSnapshot &snapshot) const
+  {
+    while (true)
+      {
+        uint64_t before = m_segment->sequence.load (std::memory_order_acquire);
+        if (before & 1)
+          {
+            sched_yield ();
+            continue;
+          }
+        std::memcpy (&snapshot, &m_segment->snapshot, sizeof (snapshot));
+        std::atomic_thread_fence (std::memory_order_acquire);
+        if (m_segment->sequence.load (std::memory_order_relaxed) == before)
+          {
+            return before / 2;
+          }
+      }
+  }
+
+private:
+  LiveStatsReader (const LiveStatsReader &);
+  LiveStatsReader &operator = (const LiveStatsReader &);
+
+  const LiveStatsSegment *m_segment;
+};
+
+#endif /* LIVE_STATS_H */
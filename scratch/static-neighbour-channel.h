@@ -0,0 +1,356 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Spectrum channel that precomputes the link budgets of a static
+// topology, for the --staticChannel mode of 2.cc, 4.cc, expossed.cc and
+// wifi-hidden-terminal.cc.
+
+#ifndef STATIC_NEIGHBOUR_CHANNEL_H
+#define STATIC_NEIGHBOUR_CHANNEL_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/angles.h"
+#include "ns3/antenna-model.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/single-model-spectrum-channel.h"
+#include "ns3/spectrum-phy.h"
+#include "ns3/spectrum-signal-parameters.h"
+#include "ns3/spectrum-value.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief A SingleModelSpectrumChannel for topologies that do not move
+ *
+ * The first frame a PHY sends builds its neighbour list: every other
+ * PHY with the gain of the link (propagation loss model plus antenna
+ * gains) and its propagation delay, sorted by decreasing gain. A frame
+ * is then delivered down that list only while the rx power is at least
+ * RxPowerThreshold, so its cost is proportional to the receivers that
+ * can hear it rather than to all PHYs on the channel. A CourseChange of
+ * any PHY's mobility model, or a PHY being added, drops every list.
+ * Models with a non-zero velocity move without firing CourseChange, so
+ * when the sender or any receiver has one the list is not kept and is
+ * rebuilt for every frame.
+ *
+ * Receivers with the same gain get the same SpectrumSignalParameters,
+ * so a frame that all PHYs hear equally well costs one copy of them
+ * and of its power spectral density rather than one per receiver;
+ * SpectrumWifiPhy only reads them and copies the packet it passes up.
+ * A SpectrumPropagationLossModel makes every reception its own copy
+ * again.
+ *
+ * With a positive BatchWindow the receptions of a frame are sorted by
+ * propagation delay and cut into groups, each holding the earliest
+ * reception not yet grouped and every later one within BatchWindow of
+ * it, and a group is delivered by a single event at its first delay.
+ * A reception then starts up to BatchWindow early, and it runs, with
+ * everything its PHY schedules from it, in the context of the group's
+ * first receiver rather than its own; that shows in log prefixes and
+ * in anything else that reads Simulator::GetContext.
+ *
+ * The propagation loss model must be deterministic. Signals below the
+ * threshold are dropped rather than added to the receiver's
+ * interference, and the PathLoss and Gain traces are not fired.
+ */
+class StaticNeighbourSpectrumChannel : public SingleModelSpectrumChannel
+{
+public:
+  static TypeId GetTypeId (void);
+  StaticNeighbourSpectrumChannel ();
+  virtual ~StaticNeighbourSpectrumChannel ();
+
+  virtual void AddRx (Ptr<SpectrumPhy> phy);
+  virtual void StartTx (Ptr<SpectrumSignalParameters> params);
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  struct Neighbour
+  {
+    Ptr<SpectrumPhy> phy;
+    double gainDb;
+    Time delay;
+    bool hasNode;       ///< whether phy is attached to a node
+    uint32_t node;      ///< context of the reception if hasNode
+  };
+  typedef std::vector<Neighbour> NeighbourList;
+  /// A reception waiting to be put in a batch
+  struct Pending
+  {
+    Neighbour const *neighbour;
+    Ptr<SpectrumSignalParameters> params;
+  };
+  /// Receptions delivered by one event, in delay order
+  struct Batch : public SimpleRefCount<Batch>
+  {
+    std::vector<std::pair<Ptr<SpectrumPhy>, Ptr<SpectrumSignalParameters> > > receptions;
+  };
+
+  static bool CompareGain (Neighbour const &a, Neighbour const &b);
+  static bool CompareDelay (Pending const &a, Pending const &b);
+  /// Group pending by delay into batches of BatchWindow and schedule them
+  void ScheduleBatches (std::vector<Pending> &pending);
+  static void DeliverBatch (Ptr<Batch> batch);
+  /**
+   * Fill list with every PHY but the sender of params, by decreasing gain.
+   *
+   * \return false if a mobility model involved has a velocity
+   */
+  bool BuildNeighbours (Ptr<SpectrumSignalParameters> params, NeighbourList &list);
+  /// \return false if m has a velocity; connects to its CourseChange once
+  bool Watch (Ptr<MobilityModel> m);
+  void CourseChanged (Ptr<const MobilityModel> m);
+
+  double m_threshold;
+  Time m_batchWindow;
+  std::vector<Ptr<SpectrumPhy> > m_phys;
+  std::unordered_map<const SpectrumPhy *, NeighbourList> m_neighbours;
+  std::set<const MobilityModel *> m_watched;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (StaticNeighbourSpectrumChannel);
+
+TypeId
+StaticNeighbourSpectrumChannel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::StaticNeighbourSpectrumChannel")
+    .SetParent<SingleModelSpectrumChannel> ()
+    .SetGroupName ("Spectrum")
+    .AddConstructor<StaticNeighbourSpectrumChannel> ()
+    .AddAttribute ("RxPowerThreshold", "Receivers below this rx power (dBm) get no reception; "
+                   "set it no higher than the PHY's reception threshold.",
+                   DoubleValue (-101.0),
+                   MakeDoubleAccessor (&StaticNeighbourSpectrumChannel::m_threshold),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("BatchWindow", "If positive, the receptions of a frame whose propagation delays "
+                   "differ by at most this much are delivered by one event; 0 schedules every "
+                   "reception on its own.",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&StaticNeighbourSpectrumChannel::m_batchWindow),
+                   MakeTimeChecker ())
+  ;
+  return tid;
+}
+
+StaticNeighbourSpectrumChannel::StaticNeighbourSpectrumChannel ()
+  : m_threshold (-101.0),
+    m_batchWindow (Seconds (0))
+{
+}
+
+StaticNeighbourSpectrumChannel::~StaticNeighbourSpectrumChannel ()
+{
+}
+
+void
+StaticNeighbourSpectrumChannel::DoDispose (void)
+{
+  m_phys.clear ();
+  m_neighbours.clear ();
+  SingleModelSpectrumChannel::DoDispose ();
+}
+
+void
+StaticNeighbourSpectrumChannel::AddRx (Ptr<SpectrumPhy> phy)
+{
+  SingleModelSpectrumChannel::AddRx (phy);
+  m_phys.push_back (phy);
+  m_neighbours.clear ();
+}
+
+bool
+StaticNeighbourSpectrumChannel::Watch (Ptr<MobilityModel> m)
+{
+  if (m == 0)
+    {
+      return true;
+    }
+  if (m_watched.insert (PeekPointer (m)).second)
+    {
+      m->TraceConnectWithoutContext ("CourseChange", MakeCallback (&StaticNeighbourSpectrumChannel::CourseChanged, this));
+    }
+  Vector v = m->GetVelocity ();
+  return v.x == 0 && v.y == 0 && v.z == 0;
+}
+
+void
+StaticNeighbourSpectrumChannel::CourseChanged (Ptr<const MobilityModel> m)
+{
+  m_neighbours.clear ();
+}
+
+bool
+StaticNeighbourSpectrumChannel::CompareGain (Neighbour const &a, Neighbour const &b)
+{
+  return a.gainDb > b.gainDb;
+}
+
+bool
+StaticNeighbourSpectrumChannel::CompareDelay (Pending const &a, Pending const &b)
+{
+  return a.neighbour->delay < b.neighbour->delay;
+}
+
+bool
+StaticNeighbourSpectrumChannel::BuildNeighbours (Ptr<SpectrumSignalParameters> params, NeighbourList &list)
+{
+  Ptr<MobilityModel> txMobility = params->txPhy->GetMobility ();
+  bool still = Watch (txMobility);
+  list.clear ();
+  list.reserve (m_phys.size ());
+  for (std::vector<Ptr<SpectrumPhy> >::const_iterator i = m_phys.begin (); i != m_phys.end (); ++i)
+    {
+      if (*i == params->txPhy)
+        {
+          continue;
+        }
+      Neighbour n;
+      n.phy = *i;
+      n.gainDb = 0;
+      n.delay = Seconds (0);
+      Ptr<MobilityModel> rxMobility = (*i)->GetMobility ();
+      still = Watch (rxMobility) && still;
+      if (txMobility && rxMobility)
+        {
+          if (params->txAntenna)
+            {
+              n.gainDb += params->txAntenna->GetGainDb (Angles (rxMobility->GetPosition (), txMobility->GetPosition ()));
+            }
+          if ((*i)->GetRxAntenna ())
+            {
+              n.gainDb += (*i)->GetRxAntenna ()->GetGainDb (Angles (txMobility->GetPosition (), rxMobility->GetPosition ()));
+            }
+          if (m_propagationLoss)
+            {
+              n.gainDb += m_propagationLoss->CalcRxPower (0, txMobility, rxMobility);
+            }
+          if (m_propagationDelay)
+            {
+              n.delay = m_propagationDelay->GetDelay (txMobility, rxMobility);
+            }
+        }
+      Ptr<NetDevice> device = (*i)->GetDevice ();
+      n.hasNode = device && device->GetNode ();
+      n.node = n.hasNode ? device->GetNode ()->GetId () : 0;
+      list.push_back (n);
+    }
+  std::stable_sort (list.begin (), list.end (), &StaticNeighbourSpectrumChannel::CompareGain);
+  return still;
+}
+
+void
+StaticNeighbourSpectrumChannel::StartTx (Ptr<SpectrumSignalParameters> txParams)
+{
+  NS_ASSERT_MSG (txParams->psd, "NULL txPsd");
+  NS_ASSERT_MSG (txParams->txPhy, "NULL txPhy");
+
+  NeighbourList uncached;
+  NeighbourList *list = &uncached;
+  std::unordered_map<const SpectrumPhy *, NeighbourList>::iterator it = m_neighbours.find (PeekPointer (txParams->txPhy));
+  if (it != m_neighbours.end ())
+    {
+      list = &it->second;
+    }
+  else if (BuildNeighbours (txParams, uncached))
+    {
+      list = &m_neighbours[PeekPointer (txParams->txPhy)];
+      list->swap (uncached);
+    }
+
+  // Integral () of the psd is the tx power in W
+  double minGainDb = m_threshold - (10 * std::log10 (Integral (*txParams->psd)) + 30);
+  Ptr<MobilityModel> txMobility = txParams->txPhy->GetMobility ();
+  Ptr<SpectrumSignalParameters> rxParams;
+  std::vector<Pending> pending;
+  for (NeighbourList::const_iterator n = list->begin (); n != list->end () && n->gainDb >= minGainDb; ++n)
+    {
+      // the list is sorted by gain, so receivers with the same gain are
+      // next to each other and can share the parameters
+      if (rxParams == 0 || n->gainDb != (n - 1)->gainDb || m_spectrumPropagationLoss)
+        {
+          rxParams = txParams->Copy ();
+          *(rxParams->psd) *= std::pow (10.0, n->gainDb / 10.0);
+          if (m_spectrumPropagationLoss && txMobility && n->phy->GetMobility ())
+            {
+              rxParams->psd = m_spectrumPropagationLoss->CalcRxPowerSpectralDensity (rxParams->psd, txMobility, n->phy->GetMobility ());
+            }
+        }
+      if (m_batchWindow.IsStrictlyPositive ())
+        {
+          Pending p = { &*n, rxParams };
+          pending.push_back (p);
+        }
+      else if (n->hasNode)
+        {
+          Simulator::ScheduleWithContext (n->node, n->delay, &SpectrumPhy::StartRx, n->phy, rxParams);
+        }
+      else
+        {
+          Simulator::Schedule (n->delay, &SpectrumPhy::StartRx, n->phy, rxParams);
+        }
+    }
+  if (!pending.empty ())
+    {
+      ScheduleBatches (pending);
+    }
+}
+
+void
+StaticNeighbourSpectrumChannel::ScheduleBatches (std::vector<Pending> &pending)
+{
+  std::stable_sort (pending.begin (), pending.end (), &StaticNeighbourSpectrumChannel::CompareDelay);
+  for (size_t first = 0; first < pending.size (); )
+    {
+      Neighbour const *head = pending[first].neighbour;
+      Ptr<Batch> batch = Create<Batch> ();
+      for (; first < pending.size () && pending[first].neighbour->delay - head->delay <= m_batchWindow; ++first)
+        {
+          batch->receptions.push_back (std::make_pair (pending[first].neighbour->phy, pending[first].params));
+        }
+      if (head->hasNode)
+        {
+          Simulator::ScheduleWithContext (head->node, head->delay, &StaticNeighbourSpectrumChannel::DeliverBatch, batch);
+        }
+      else
+        {
+          Simulator::Schedule (head->delay, &StaticNeighbourSpectrumChannel::DeliverBatch, batch);
+        }
+    }
+}
+
+void
+StaticNeighbourSpectrumChannel::DeliverBatch (Ptr<Batch> batch)
+{
+  for (size_t i = 0; i < batch->receptions.size (); ++i)
+    {
+      batch->receptions[i].first->StartRx (batch->receptions[i].second);
+    }
+}
+
+} // namespace ns3
+
+#endif /* STATIC_NEIGHBOUR_CHANNEL_H */
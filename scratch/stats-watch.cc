@@ -0,0 +1,118 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Follows the live stats segment of a running simulation (see
+// live-stats.h), e.g. of "aodv_lab --liveStats=/aodv":
+//
+//   ./waf --run "stats-watch /aodv"
+//   ./waf --run "stats-watch --flows --interval=5 /aodv"
+//
+// Prints one line per interval until the simulation finishes or its
+// process is gone, flagging intervals in which no event was executed.
+// With --flows the FlowMonitor counters of every flow follow each line.
+
+#include "live-stats.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static void
+PrintAddress (uint32_t address)
+{
+  std::printf ("%u.%u.%u.%u", address >> 24, (address >> 16) & 0xff, (address >> 8) & 0xff, address & 0xff);
+}
+
+int
+main (int argc, char *argv[])
+{
+  bool flows = false;
+  double interval = 1;
+  const char *name = 0;
+  for (int a = 1; a < argc; ++a)
+    {
+      if (std::strcmp (argv[a], "--flows") == 0)
+        {
+          flows = true;
+        }
+      else if (std::strncmp (argv[a], "--interval=", 11) == 0)
+        {
+          interval = std::atof (argv[a] + 11);
+        }
+      else if (name == 0)
+        {
+          name = argv[a];
+        }
+      else
+        {
+          name = 0;
+          break;
+        }
+    }
+  if (name == 0 || interval <= 0)
+    {
+      std::cerr << "usage: stats-watch [--flows] [--interval=SECONDS] NAME" << std::endl;
+      return 1;
+    }
+
+  LiveStatsReader reader;
+  if (!reader.Open (name))
+    {
+      std::cerr << "no live stats segment " << name << std::endl;
+      return 1;
+    }
+  std::printf ("%10s %14s %12s %10s %9s %8s\n", "Wall(s)", "SimTime(s)", "Events/s", "Queue", "RSS(MB)", "Flows");
+  LiveStatsSnapshot s;
+  uint64_t lastEvents = 0;
+  while (true)
+    {
+      uint64_t sequence = reader.Read (s);
+      if (sequence != 0)
+        {
+          std::printf ("%10.1f %14.6f %12.0f %10lu %9.1f %8u%s\n",
+                       s.wallTime, s.simTime / 1e9, s.eventsPerSecond, (unsigned long) s.queueSize,
+                       s.residentBytes / 1048576.0, s.totalFlows,
+                       s.events == lastEvents && !s.finished ? "  no progress" : "");
+          lastEvents = s.events;
+          for (uint32_t i = 0; flows && i < s.flowCount; ++i)
+            {
+              const LiveStatsFlow &f = s.flows[i];
+              std::printf ("  ");
+              PrintAddress (f.source);
+              std::printf (":%u -> ", f.sourcePort);
+              PrintAddress (f.destination);
+              std::printf (":%u proto %u  tx %lu rx %lu (%lu/%lu bytes)\n", f.destinationPort, f.protocol,
+                           (unsigned long) f.txPackets, (unsigned long) f.rxPackets,
+                           (unsigned long) f.txBytes, (unsigned long) f.rxBytes);
+            }
+          std::fflush (stdout);
+        }
+      if (s.finished && sequence != 0)
+        {
+          std::printf ("finished after %lu events\n", (unsigned long) s.events);
+          return 0;
+        }
+      if (kill (reader.GetPid (), 0) != 0 && errno == ESRCH)
+        {
+          std::printf ("process %u exited without finishing\n", reader.GetPid ());
+          return 1;
+        }
+      usleep (useconds_t (interval * 1e6));
+    }
+}
@@ -0,0 +1,371 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Table-driven error rate model for the 802.11b modes, for the
+// --tableErrorRate mode of 2.cc and aodv_lab.cc.
+
+#ifndef TABLE_ERROR_RATE_MODEL_H
+#define TABLE_ERROR_RATE_MODEL_H
+
+#include "ns3/core-module.h"
+#include "ns3/error-rate-model.h"
+#include "ns3/dsss-error-rate-model.h"
+#include "ns3/nist-error-rate-model.h"
+#include "ns3/wifi-mode.h"
+#include "ns3/wifi-tx-vector.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+static const double TABLE_DSSS_SNR_STEP = 0.01;   // linear SNR
+static const double TABLE_DSSS_SNR_MAX = 100;     // 20 dB
+static const char TABLE_DSSS_MAGIC[8] = { 'N', 'S', '3', 'D', 'S', 'S', 'S', 0 };
+static const uint32_t TABLE_DSSS_VERSION = 1;
+static const double TABLE_DSSS_RESOLVED = 1e-10;  // smallest -log (1 - ber) the error is measured at
+
+/**
+ * \brief DsssErrorRateModel from tables
+ *
+ * Each DSSS and CCK success rate of DsssErrorRateModel is
+ * (1 - ber (snr))^nbits, so rather than a grid over SNR and length the
+ * table of a mode holds g = log (-log (1 - ber)) on a grid of the
+ * linear SNR, and a chunk of any length succeeds with
+ * exp (-nbits exp (g)), g interpolated linearly. Where ber is small g
+ * is close to log (ber), nearly affine in the SNR for all four modes,
+ * so the error of the interpolation is largest at the lowest SNRs,
+ * where no frame gets through anyway, and at the steps of the CCK
+ * model without GSL. It is measured at the grid midpoints when the
+ * table is built (see GetMaxInterpolationError). A table ends where
+ * 1 - ber rounds to 1, above which a chunk always succeeds, as with
+ * the exact model. Modes other than the four 802.11b ones go to a
+ * NistErrorRateModel.
+ *
+ * The tables are built once per process, by the first model that needs
+ * them, or loaded from CacheFile when it holds tables for the same grid
+ * and the same DsssErrorRateModel (with or without GSL); otherwise they
+ * are written there.
+ */
+class TableDsssErrorRateModel : public ErrorRateModel
+{
+public:
+  static TypeId GetTypeId (void);
+  TableDsssErrorRateModel ();
+  virtual ~TableDsssErrorRateModel ();
+
+  virtual double GetChunkSuccessRate (WifiMode mode, WifiTxVector txVector, double snr, uint64_t nbits) const;
+
+  /// Build or load the tables now, e.g. before forking workers that all need them
+  void Prepare (void) const;
+  /**
+   * \return the largest difference between the interpolated and the
+   * exact g measured for mode, -1 if mode is not an 802.11b mode. The
+   * log of a chunk success rate is off by at most exp (error) - 1 of
+   * itself.
+   */
+  double GetMaxInterpolationError (WifiMode mode) const;
+
+private:
+  enum Modulation
+  {
+    DBPSK = 0,          //!< DsssRate1Mbps
+    DQPSK,              //!< DsssRate2Mbps
+    CCK5_5,             //!< DsssRate5_5Mbps
+    CCK11,              //!< DsssRate11Mbps
+    N_MODULATIONS,
+    OTHER = N_MODULATIONS,
+    UNKNOWN             //!< mode not classified yet
+  };
+  struct Table
+  {
+    std::vector<double> g;      ///< at snr i * TABLE_DSSS_SNR_STEP
+    bool complete;              ///< whether 1 - ber rounds to 1 from snr g.size () * TABLE_DSSS_SNR_STEP on
+    double maxError;
+  };
+  struct CacheHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t pad;
+    double step;
+    double maxSnr;
+    double probe[N_MODULATIONS];        ///< exact 1 bit success rate at snr 1
+    uint32_t points[N_MODULATIONS];
+    uint32_t complete[N_MODULATIONS];
+    double maxError[N_MODULATIONS];
+  };
+
+  static double Exact (uint32_t modulation, double snr, uint64_t nbits);
+  static double LogErrorExponent (double successRate);
+  static void Build (uint32_t modulation, Table &table);
+  static bool Load (std::string const &cacheFile, std::vector<Table> &tables);
+  static void Save (std::string const &cacheFile, std::vector<Table> const &tables);
+  static std::vector<Table> const &GetTables (std::string const &cacheFile);
+  uint32_t Classify (WifiMode mode) const;
+
+  std::string m_cacheFile;
+  Ptr<NistErrorRateModel> m_fallback;
+  mutable const std::vector<Table> *m_tables;
+  mutable std::vector<uint8_t> m_modulation;    ///< Modulation by WifiMode uid
+};
+
+NS_OBJECT_ENSURE_REGISTERED (TableDsssErrorRateModel);
+
+TypeId
+TableDsssErrorRateModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TableDsssErrorRateModel")
+    .SetParent<ErrorRateModel> ()
+    .SetGroupName ("Wifi")
+    .AddConstructor<TableDsssErrorRateModel> ()
+    .AddAttribute ("CacheFile", "File the tables are loaded from, or written to if it does not "
+                   "hold matching ones; empty to always build them.",
+                   StringValue (""),
+                   MakeStringAccessor (&TableDsssErrorRateModel::m_cacheFile),
+                   MakeStringChecker ())
+  ;
+  return tid;
+}
+
+TableDsssErrorRateModel::TableDsssErrorRateModel ()
+  : m_fallback (CreateObject<NistErrorRateModel> ()),
+    m_tables (0)
+{
+}
+
+TableDsssErrorRateModel::~TableDsssErrorRateModel ()
+{
+}
+
+double
+TableDsssErrorRateModel::Exact (uint32_t modulation, double snr, uint64_t nbits)
+{
+  switch (modulation)
+    {
+    case DBPSK:
+      return DsssErrorRateModel::GetDsssDbpskSuccessRate (snr, nbits);
+    case DQPSK:
+      return DsssErrorRateModel::GetDsssDqpskSuccessRate (snr, nbits);
+    case CCK5_5:
+      return DsssErrorRateModel::GetDsssDqpskCck5_5SuccessRate (snr, nbits);
+    default:
+      return DsssErrorRateModel::GetDsssDqpskCck11SuccessRate (snr, nbits);
+    }
+}
+
+double
+TableDsssErrorRateModel::LogErrorExponent (double successRate)
+{
+  // a 1 bit success rate of 0 would make g infinite
+  return std::log (-std::log (successRate > 1e-300 ? successRate : 1e-300));
+}
+
+void
+TableDsssErrorRateModel::Build (uint32_t modulation, Table &table)
+{
+  table.g.clear ();
+  table.complete = false;
+  for (uint32_t i = 0; i * TABLE_DSSS_SNR_STEP <= TABLE_DSSS_SNR_MAX; ++i)
+    {
+      double p = Exact (modulation, i * TABLE_DSSS_SNR_STEP, 1);
+      if (p >= 1)
+        {
+          table.complete = true;
+          break;
+        }
+      table.g.push_back (LogErrorExponent (p));
+    }
+  table.maxError = 0;
+  for (uint32_t i = 0; i + 1 < table.g.size (); ++i)
+    {
+      // 1 - ber has few significant digits left once ber nears the
+      // double epsilon, in the exact model as much as in the table
+      double p = Exact (modulation, (i + 0.5) * TABLE_DSSS_SNR_STEP, 1);
+      if (-std::log (p) < TABLE_DSSS_RESOLVED)
+        {
+          break;
+        }
+      double error = std::fabs ((table.g[i] + table.g[i + 1]) / 2 - LogErrorExponent (p));
+      table.maxError = error > table.maxError ? error : table.maxError;
+    }
+}
+
+bool
+TableDsssErrorRateModel::Load (std::string const &cacheFile, std::vector<Table> &tables)
+{
+  FILE *f = std::fopen (cacheFile.c_str (), "rb");
+  if (f == 0)
+    {
+      return false;
+    }
+  CacheHeader header;
+  bool ok = std::fread (&header, sizeof (header), 1, f) == 1
+    && std::memcmp (header.magic, TABLE_DSSS_MAGIC, sizeof (header.magic)) == 0
+    && header.version == TABLE_DSSS_VERSION
+    && header.step == TABLE_DSSS_SNR_STEP
+    && header.maxSnr == TABLE_DSSS_SNR_MAX;
+  for (uint32_t m = 0; ok && m < N_MODULATIONS; ++m)
+    {
+      // the points are read only if the file was written by the same
+      // DsssErrorRateModel, which depends on whether ns-3 has GSL
+      ok = header.probe[m] == Exact (m, 1.0, 1)
+        && header.points[m] <= TABLE_DSSS_SNR_MAX / TABLE_DSSS_SNR_STEP + 1;
+    }
+  for (uint32_t m = 0; ok && m < N_MODULATIONS; ++m)
+    {
+      tables[m].g.resize (header.points[m]);
+      tables[m].complete = header.complete[m] != 0;
+      tables[m].maxError = header.maxError[m];
+      ok = std::fread (tables[m].g.data (), sizeof (double), header.points[m], f) == header.points[m];
+    }
+  std::fclose (f);
+  return ok;
+}
+
+void
+TableDsssErrorRateModel::Save (std::string const &cacheFile, std::vector<Table> const &tables)
+{
+  FILE *f = std::fopen (cacheFile.c_str (), "wb");
+  if (f == 0)
+    {
+      NS_FATAL_ERROR ("Cannot open " << cacheFile);
+    }
+  CacheHeader header;
+  std::memset (&header, 0, sizeof (header));
+  std::memcpy (header.magic, TABLE_DSSS_MAGIC, sizeof (header.magic));
+  header.version = TABLE_DSSS_VERSION;
+  header.step = TABLE_DSSS_SNR_STEP;
+  header.maxSnr = TABLE_DSSS_SNR_MAX;
+  for (uint32_t m = 0; m < N_MODULATIONS; ++m)
+    {
+      header.probe[m] = Exact (m, 1.0, 1);
+      header.points[m] = tables[m].g.size ();
+      header.complete[m] = tables[m].complete;
+      header.maxError[m] = tables[m].maxError;
+    }
+  bool ok = std::fwrite (&header, sizeof (header), 1, f) == 1;
+  for (uint32_t m = 0; ok && m < N_MODULATIONS; ++m)
+    {
+      ok = std::fwrite (tables[m].g.data (), sizeof (double), tables[m].g.size (), f) == tables[m].g.size ();
+    }
+  if (std::fclose (f) != 0 || !ok)
+    {
+      NS_FATAL_ERROR ("Cannot write " << cacheFile);
+    }
+}
+
+std::vector<TableDsssErrorRateModel::Table> const &
+TableDsssErrorRateModel::GetTables (std::string const &cacheFile)
+{
+  static std::vector<Table> tables;
+  if (tables.empty ())
+    {
+      tables.resize (N_MODULATIONS);
+      if (cacheFile.empty () || !Load (cacheFile, tables))
+        {
+          for (uint32_t m = 0; m < N_MODULATIONS; ++m)
+            {
+              Build (m, tables[m]);
+            }
+          if (!cacheFile.empty ())
+            {
+              Save (cacheFile, tables);
+            }
+        }
+    }
+  return tables;
+}
+
+void
+TableDsssErrorRateModel::Prepare (void) const
+{
+  m_tables = &GetTables (m_cacheFile);
+}
+
+uint32_t
+TableDsssErrorRateModel::Classify (WifiMode mode) const
+{
+  uint32_t uid = mode.GetUid ();
+  if (uid >= m_modulation.size ())
+    {
+      m_modulation.resize (uid + 1, UNKNOWN);
+    }
+  if (m_modulation[uid] == UNKNOWN)
+    {
+      std::string name = mode.GetUniqueName ();
+      m_modulation[uid] = name == "DsssRate1Mbps" ? DBPSK
+        : name == "DsssRate2Mbps" ? DQPSK
+        : name == "DsssRate5_5Mbps" ? CCK5_5
+        : name == "DsssRate11Mbps" ? CCK11
+        : OTHER;
+    }
+  return m_modulation[uid];
+}
+
+double
+TableDsssErrorRateModel::GetMaxInterpolationError (WifiMode mode) const
+{
+  uint32_t modulation = Classify (mode);
+  if (modulation == OTHER)
+    {
+      return -1;
+    }
+  Prepare ();
+  return (*m_tables)[modulation].maxError;
+}
+
+double
+TableDsssErrorRateModel::GetChunkSuccessRate (WifiMode mode, WifiTxVector txVector, double snr, uint64_t nbits) const
+{
+  uint32_t modulation = Classify (mode);
+  if (modulation == OTHER)
+    {
+      return m_fallback->GetChunkSuccessRate (mode, txVector, snr, nbits);
+    }
+  if (m_tables == 0)
+    {
+      Prepare ();
+    }
+  Table const &table = (*m_tables)[modulation];
+  double x = snr > 0 ? snr / TABLE_DSSS_SNR_STEP : 0;
+  double g;
+  if (x + 1 < table.g.size ())
+    {
+      uint32_t i = uint32_t (x);
+      g = table.g[i] + (x - i) * (table.g[i + 1] - table.g[i]);
+    }
+  else if (!table.complete)
+    {
+      return Exact (modulation, snr, nbits);
+    }
+  else if (x < table.g.size ())
+    {
+      g = table.g.back ();
+    }
+  else
+    {
+      return 1;
+    }
+  return std::exp (-double (nbits) * std::exp (g));
+}
+
+} // namespace ns3
+
+#endif /* TABLE_ERROR_RATE_MODEL_H */
@@ -22,10 +22,31 @@
 #include "ns3/csma-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/yans-wifi-helper.h"
+#include "ns3/wifi-net-device.h"
+#include "ns3/wifi-phy.h"
 #include "ns3/ssid.h"
 #include "ns3/netanim-module.h"
 #include "ns3/flow-monitor.h"
 #include "ns3/flow-monitor-helper.h"
+#include "ns3/ipv4-flow-classifier.h"
+#include "async-trace-file.h"
+#include "flowmon-binary.h"
+#include "flowmon-streamer.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 // Default Network Topology
 //
@@ -41,6 +62,715 @@
 using namespace ns3;
 NS_LOG_COMPONENT_DEFINE("third");
 
+/**
+ * Decides which packets the trace sinks record. Parsed from space
+ * separated terms such as
+ *
+ *   "src=10.1.3.3 dst=10.1.2.4 proto=udp dport=9 bidir=1 nodes=0,7 devices=wifi,csma start=2 stop=5"
+ *
+ * Nodes and device types (p2p, csma, wifi) are checked once, when the
+ * sinks are connected, so excluded devices are not traced at all. The
+ * [start, stop) window in seconds and the five-tuple are checked for
+ * each packet before the sink formats or copies it; the five-tuple is
+ * read from the first bytes of the frame. With bidir=1 the reversed
+ * five-tuple (the echo reply) matches too.
+ */
+class TraceFilter
+{
+public:
+  /// What is in front of the IPv4 header of the traced frames
+  enum LinkType
+  {
+    LINK_PPP,           //!< PPP header, or none (point-to-point MacRx)
+    LINK_ETHERNET,
+    LINK_WIFI
+  };
+
+  TraceFilter ();
+  void Parse (std::string spec);
+  bool IsEmpty (void) const;
+  bool AcceptsDevice (Ptr<NetDevice> device) const;
+  bool Accepts (Ptr<const Packet> packet, LinkType linkType) const;
+
+private:
+  bool Matches (Ipv4Address source, Ipv4Address destination, int32_t sourcePort, int32_t destinationPort) const;
+
+  bool m_empty;
+  bool m_matchHeaders;
+  bool m_bidirectional;
+  bool m_hasSource;
+  bool m_hasDestination;
+  Ipv4Address m_source;
+  Ipv4Address m_destination;
+  int32_t m_sourcePort;         //!< -1 for any
+  int32_t m_destinationPort;    //!< -1 for any
+  int32_t m_protocol;           //!< -1 for any
+  std::set<uint32_t> m_nodes;   //!< empty for any
+  std::set<std::string> m_devices;  //!< empty for any
+  Time m_start;
+  Time m_stop;
+};
+
+TraceFilter::TraceFilter ()
+  : m_empty (true),
+    m_matchHeaders (false),
+    m_bidirectional (false),
+    m_hasSource (false),
+    m_hasDestination (false),
+    m_sourcePort (-1),
+    m_destinationPort (-1),
+    m_protocol (-1),
+    m_start (Seconds (0)),
+    m_stop (Time::Max ())
+{
+}
+
+void
+TraceFilter::Parse (std::string spec)
+{
+  std::istringstream terms (spec);
+  std::string term;
+  while (terms >> term)
+    {
+      std::string::size_type eq = term.find ('=');
+      if (eq == std::string::npos)
+        {
+          NS_FATAL_ERROR ("traceFilter term " << term << " is not key=value");
+        }
+      std::string key = term.substr (0, eq);
+      std::string value = term.substr (eq + 1);
+      std::istringstream list (value);
+      std::string item;
+      m_empty = false;
+      if (key == "src")
+        {
+          m_source = Ipv4Address (value.c_str ());
+          m_hasSource = true;
+          m_matchHeaders = true;
+        }
+      else if (key == "dst")
+        {
+          m_destination = Ipv4Address (value.c_str ());
+          m_hasDestination = true;
+          m_matchHeaders = true;
+        }
+      else if (key == "sport")
+        {
+          m_sourcePort = std::atoi (value.c_str ());
+          m_matchHeaders = true;
+        }
+      else if (key == "dport")
+        {
+          m_destinationPort = std::atoi (value.c_str ());
+          m_matchHeaders = true;
+        }
+      else if (key == "proto")
+        {
+          m_protocol = value == "udp" ? 17 : value == "tcp" ? 6 : std::atoi (value.c_str ());
+          m_matchHeaders = true;
+        }
+      else if (key == "bidir")
+        {
+          m_bidirectional = value == "1" || value == "true";
+        }
+      else if (key == "nodes")
+        {
+          while (std::getline (list, item, ','))
+            {
+              m_nodes.insert (std::atoi (item.c_str ()));
+            }
+        }
+      else if (key == "devices")
+        {
+          while (std::getline (list, item, ','))
+            {
+              if (item != "p2p" && item != "csma" && item != "wifi")
+                {
+                  NS_FATAL_ERROR ("traceFilter device type " << item << " is not p2p, csma or wifi");
+                }
+              m_devices.insert (item);
+            }
+        }
+      else if (key == "start")
+        {
+          m_start = Seconds (std::atof (value.c_str ()));
+        }
+      else if (key == "stop")
+        {
+          m_stop = Seconds (std::atof (value.c_str ()));
+        }
+      else
+        {
+          NS_FATAL_ERROR ("Unknown traceFilter key " << key);
+        }
+    }
+}
+
+bool
+TraceFilter::IsEmpty (void) const
+{
+  return m_empty;
+}
+
+bool
+TraceFilter::AcceptsDevice (Ptr<NetDevice> device) const
+{
+  if (!m_nodes.empty () && m_nodes.count (device->GetNode ()->GetId ()) == 0)
+    {
+      return false;
+    }
+  if (m_devices.empty ())
+    {
+      return true;
+    }
+  return (DynamicCast<PointToPointNetDevice> (device) && m_devices.count ("p2p"))
+         || (DynamicCast<CsmaNetDevice> (device) && m_devices.count ("csma"))
+         || (DynamicCast<WifiNetDevice> (device) && m_devices.count ("wifi"));
+}
+
+bool
+TraceFilter::Accepts (Ptr<const Packet> packet, LinkType linkType) const
+{
+  Time now = Simulator::Now ();
+  if (now < m_start || now >= m_stop)
+    {
+      return false;
+    }
+  if (!m_matchHeaders)
+    {
+      return true;
+    }
+
+  uint8_t b[96];
+  uint32_t n = packet->CopyData (b, sizeof (b));
+  uint32_t ip = 0;
+  switch (linkType)
+    {
+    case LINK_PPP:
+      // MacRx fires after the PPP header is removed; an IPv4 header never starts with 0x00
+      if (n >= 2 && b[0] == 0x00)
+        {
+          if (b[1] != 0x21)
+            {
+              return false;
+            }
+          ip = 2;
+        }
+      break;
+    case LINK_ETHERNET:
+      ip = 14;
+      if (n >= 14 && ((b[12] << 8) | b[13]) < 1536)
+        {
+          ip += 8;              // 802.3 length field followed by LLC/SNAP
+        }
+      if (n < ip || ((b[ip - 2] << 8) | b[ip - 1]) != 0x0800)
+        {
+          return false;
+        }
+      break;
+    case LINK_WIFI:
+      // data frames only: MAC header, QoS control, fourth address, then LLC/SNAP
+      if (n < 2 || ((b[0] >> 2) & 3) != 2)
+        {
+          return false;
+        }
+      ip = 24 + (b[0] & 0x80 ? 2 : 0) + ((b[1] & 3) == 3 ? 6 : 0) + 8;
+      if (n < ip || ((b[ip - 2] << 8) | b[ip - 1]) != 0x0800)
+        {
+          return false;
+        }
+      break;
+    }
+  if (n < ip + 20 || (b[ip] >> 4) != 4)
+    {
+      return false;
+    }
+
+  uint8_t protocol = b[ip + 9];
+  if (m_protocol >= 0 && protocol != m_protocol)
+    {
+      return false;
+    }
+  Ipv4Address source = Ipv4Address::Deserialize (b + ip + 12);
+  Ipv4Address destination = Ipv4Address::Deserialize (b + ip + 16);
+  int32_t sourcePort = -1;
+  int32_t destinationPort = -1;
+  uint32_t l4 = ip + (b[ip] & 0x0f) * 4;
+  bool firstFragment = (((b[ip + 6] & 0x1f) << 8) | b[ip + 7]) == 0;
+  if ((protocol == 6 || protocol == 17) && firstFragment && n >= l4 + 4)
+    {
+      sourcePort = (b[l4] << 8) | b[l4 + 1];
+      destinationPort = (b[l4 + 2] << 8) | b[l4 + 3];
+    }
+  return Matches (source, destination, sourcePort, destinationPort)
+         || (m_bidirectional && Matches (destination, source, destinationPort, sourcePort));
+}
+
+bool
+TraceFilter::Matches (Ipv4Address source, Ipv4Address destination, int32_t sourcePort, int32_t destinationPort) const
+{
+  return (!m_hasSource || source == m_source)
+         && (!m_hasDestination || destination == m_destination)
+         && (m_sourcePort < 0 || sourcePort == m_sourcePort)
+         && (m_destinationPort < 0 || destinationPort == m_destinationPort);
+}
+
+/**
+ * One ascii trace source of one device. The lines are the ones the
+ * AsciiTraceHelper default sinks and the YansWifiPhyHelper ascii sinks
+ * write, byte for byte, but built without a stream per field: the
+ * context path is kept here instead of being passed per call, the time
+ * goes through snprintf ("%g" is what the ostream default formatting
+ * uses), and the line is written at once without a per line flush.
+ *
+ * The packet itself is still printed by Packet::Print, which walks the
+ * packet metadata and calls every header's and trailer's Print through
+ * a stream. That is where most of the time per line goes, so this only
+ * saves the overhead around it; formatting the headers here would mean
+ * keeping a copy of each header's Print output in step with ns-3.
+ */
+struct AsciiTraceSink
+{
+  const TraceFilter *filter;
+  TraceFilter::LinkType linkType;
+  Ptr<OutputStreamWrapper> stream;
+  char event;                   //!< +, -, d, r or t
+  std::string context;
+};
+
+/// Write "<event> <time> <context> [<mode> ]<packet>\n"
+static void
+WriteAsciiTraceLine (AsciiTraceSink *sink, const std::string *mode, Ptr<const Packet> p)
+{
+  static std::ostringstream packetText;
+  static std::string line;
+
+  char time[32];
+  int timeLength = std::snprintf (time, sizeof (time), "%g", Simulator::Now ().GetSeconds ());
+  packetText.str ("");
+  p->Print (packetText);
+  const std::string &packet = packetText.str ();
+
+  line.clear ();
+  line += sink->event;
+  line += ' ';
+  line.append (time, timeLength);
+  line += ' ';
+  line += sink->context;
+  line += ' ';
+  if (mode)
+    {
+      line += *mode;
+      line += ' ';
+    }
+  line += packet;
+  line += '\n';
+  sink->stream->GetStream ()->write (line.data (), line.size ());
+}
+
+static void
+AsciiPacketSink (AsciiTraceSink *sink, Ptr<const Packet> p)
+{
+  if (sink->filter->Accepts (p, sink->linkType))
+    {
+      WriteAsciiTraceLine (sink, 0, p);
+    }
+}
+
+static void
+AsciiWifiTxSink (AsciiTraceSink *sink, Ptr<const Packet> p, WifiMode mode, WifiPreamble preamble, uint8_t txLevel)
+{
+  if (sink->filter->Accepts (p, sink->linkType))
+    {
+      std::string name = mode.GetUniqueName ();
+      WriteAsciiTraceLine (sink, &name, p);
+    }
+}
+
+static void
+AsciiWifiRxSink (AsciiTraceSink *sink, Ptr<const Packet> p, double snr, WifiMode mode, WifiPreamble preamble)
+{
+  if (sink->filter->Accepts (p, sink->linkType))
+    {
+      std::string name = mode.GetUniqueName ();
+      WriteAsciiTraceLine (sink, &name, p);
+    }
+}
+
+/**
+ * Connect, on every device the filter accepts, the trace sources
+ * EnableAsciiAll of the device's helper would connect, writing to the
+ * stream of the device's type. An empty filter accepts everything.
+ * \return the sinks, to be deleted after Simulator::Destroy
+ */
+static std::vector<AsciiTraceSink *>
+EnableFilteredAscii (const TraceFilter *filter, Ptr<OutputStreamWrapper> p2pStream,
+                     Ptr<OutputStreamWrapper> csmaStream, Ptr<OutputStreamWrapper> wifiStream)
+{
+  struct Source
+  {
+    const char *name;
+    char event;
+  };
+  static const Source p2pSources[] = {
+    { "MacRx", 'r' }, { "TxQueue/Enqueue", '+' }, { "TxQueue/Dequeue", '-' }, { "TxQueue/Drop", 'd' }, { "PhyRxDrop", 'd' }
+  };
+  static const Source csmaSources[] = {
+    { "MacRx", 'r' }, { "TxQueue/Enqueue", '+' }, { "TxQueue/Dequeue", '-' }, { "TxQueue/Drop", 'd' }
+  };
+
+  std::vector<AsciiTraceSink *> sinks;
+  for (NodeList::Iterator node = NodeList::Begin (); node != NodeList::End (); ++node)
+    {
+      for (uint32_t i = 0; i < (*node)->GetNDevices (); ++i)
+        {
+          Ptr<NetDevice> device = (*node)->GetDevice (i);
+          if (!filter->AcceptsDevice (device))
+            {
+              continue;
+            }
+          std::ostringstream oss;
+          oss << "/NodeList/" << (*node)->GetId () << "/DeviceList/" << i << "/";
+          const Source *sources = 0;
+          uint32_t nSources = 0;
+          AsciiTraceSink sink = { filter, TraceFilter::LINK_PPP, p2pStream, 0, "" };
+          if (DynamicCast<PointToPointNetDevice> (device))
+            {
+              oss << "$ns3::PointToPointNetDevice/";
+              sources = p2pSources;
+              nSources = sizeof (p2pSources) / sizeof (p2pSources[0]);
+            }
+          else if (DynamicCast<CsmaNetDevice> (device))
+            {
+              oss << "$ns3::CsmaNetDevice/";
+              sink.linkType = TraceFilter::LINK_ETHERNET;
+              sink.stream = csmaStream;
+              sources = csmaSources;
+              nSources = sizeof (csmaSources) / sizeof (csmaSources[0]);
+            }
+          else if (DynamicCast<WifiNetDevice> (device))
+            {
+              oss << "$ns3::WifiNetDevice/Phy/State/";
+              sink.linkType = TraceFilter::LINK_WIFI;
+              sink.stream = wifiStream;
+
+              sink.event = 'r';
+              sink.context = oss.str () + "RxOk";
+              sinks.push_back (new AsciiTraceSink (sink));
+              Config::ConnectWithoutContext (sink.context, MakeBoundCallback (&AsciiWifiRxSink, sinks.back ()));
+              sink.event = 't';
+              sink.context = oss.str () + "Tx";
+              sinks.push_back (new AsciiTraceSink (sink));
+              Config::ConnectWithoutContext (sink.context, MakeBoundCallback (&AsciiWifiTxSink, sinks.back ()));
+            }
+          for (uint32_t s = 0; s < nSources; ++s)
+            {
+              sink.event = sources[s].event;
+              sink.context = oss.str () + sources[s].name;
+              sinks.push_back (new AsciiTraceSink (sink));
+              Config::ConnectWithoutContext (sink.context, MakeBoundCallback (&AsciiPacketSink, sinks.back ()));
+            }
+        }
+    }
+  return sinks;
+}
+
+/**
+ * Pcap file written through an external gzip or zstd process, so the
+ * capture is compressed as it is produced and on another core. The
+ * decompressed stream is an ordinary pcap file (microsecond
+ * timestamps, snaplen 65535, like PcapHelper writes). With compressor
+ * "none" the pcap file is written directly, which is still useful to
+ * apply a TraceFilter.
+ *
+ * The compressor runs as a child process rather than on a thread
+ * because gzip and zstd are only available here as executables, not
+ * as libraries the scripts are linked with. It is executed directly,
+ * without a shell, with the output file as its stdout and one end of
+ * a socket pair as its stdin; a compressor that cannot be executed is
+ * reported through a close-on-exec status pipe. The records are sent
+ * with MSG_NOSIGNAL, so a compressor that dies makes the next write
+ * fail with EPIPE instead of raising SIGPIPE, and the process signal
+ * dispositions are left alone. Any failed write, or a compressor that
+ * does not exit cleanly, is fatal.
+ */
+class CompressedPcapFile
+{
+public:
+  /// compressor is "none", "gzip" or "zstd"; ".gz" or ".zst" is appended to filename
+  CompressedPcapFile (std::string filename, std::string compressor, uint32_t dataLinkType);
+  ~CompressedPcapFile ();
+  /// Only write the packets filter accepts
+  void SetFilter (const TraceFilter *filter);
+  void Write (Ptr<const Packet> packet);
+
+  static void PacketSniffer (CompressedPcapFile *file, Ptr<const Packet> packet);
+  static void WifiRxSniffer (CompressedPcapFile *file, Ptr<const Packet> packet, uint16_t channelFreqMhz,
+                             WifiTxVector txVector, MpduInfo aMpdu, SignalNoiseDbm signalNoise);
+  static void WifiTxSniffer (CompressedPcapFile *file, Ptr<const Packet> packet, uint16_t channelFreqMhz,
+                             WifiTxVector txVector, MpduInfo aMpdu);
+
+private:
+  static const uint32_t SNAP_LEN = 65535;
+
+  static const size_t BUFFER_SIZE = 1 << 20;
+
+  /// Run argv, a null terminated compressor command, writing to fd, the open m_filename
+  void StartCompressor (std::vector<const char *> const &argv, int fd);
+  /// Buffer size bytes of data
+  void Put (const void *data, size_t size);
+  /// Write out the buffer or fail
+  void Flush (void);
+
+  std::string m_filename;       ///< of the file written, for messages
+  int m_fd;                     ///< the file, or the socket to the compressor
+  pid_t m_pid;                  ///< the compressor, or 0
+  std::vector<uint8_t> m_out;   ///< not yet written
+  TraceFilter::LinkType m_linkType;
+  const TraceFilter *m_filter;
+  std::vector<uint8_t> m_buffer;
+};
+
+CompressedPcapFile::CompressedPcapFile (std::string filename, std::string compressor, uint32_t dataLinkType)
+  : m_filename (filename),
+    m_fd (-1),
+    m_pid (0),
+    m_linkType (dataLinkType == PcapHelper::DLT_PPP ? TraceFilter::LINK_PPP
+                : dataLinkType == PcapHelper::DLT_EN10MB ? TraceFilter::LINK_ETHERNET
+                : TraceFilter::LINK_WIFI),
+    m_filter (0)
+{
+  std::vector<const char *> argv;
+  if (compressor == "gzip")
+    {
+      m_filename = filename + ".gz";
+      argv.push_back ("gzip");
+      argv.push_back ("-c");
+      argv.push_back (0);
+    }
+  else if (compressor == "zstd")
+    {
+      m_filename = filename + ".zst";
+      argv.push_back ("zstd");
+      argv.push_back ("-q");
+      argv.push_back ("-c");
+      argv.push_back (0);
+    }
+  else if (compressor != "none")
+    {
+      NS_FATAL_ERROR ("Unknown pcap compressor " << compressor);
+    }
+  int fd = open (m_filename.c_str (), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0)
+    {
+      NS_FATAL_ERROR ("Cannot open " << m_filename << ": " << std::strerror (errno));
+    }
+  if (argv.empty ())
+    {
+      m_fd = fd;
+    }
+  else
+    {
+      StartCompressor (argv, fd);
+    }
+  m_out.reserve (BUFFER_SIZE);
+
+  uint32_t magic = 0xa1b2c3d4;
+  uint16_t version[2] = { 2, 4 };
+  int32_t thisZone = 0;
+  uint32_t sigFigs = 0;
+  uint32_t snapLen = SNAP_LEN;
+  Put (&magic, sizeof (magic));
+  Put (version, sizeof (version));
+  Put (&thisZone, sizeof (thisZone));
+  Put (&sigFigs, sizeof (sigFigs));
+  Put (&snapLen, sizeof (snapLen));
+  Put (&dataLinkType, sizeof (dataLinkType));
+}
+
+void
+CompressedPcapFile::StartCompressor (std::vector<const char *> const &argv, int fd)
+{
+  // Every descriptor kept here is close-on-exec, so no other
+  // compressor inherits the socket and keeps this one from seeing EOF
+  int data[2];
+  int status[2];
+  if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, data) != 0 || pipe2 (status, O_CLOEXEC) != 0)
+    {
+      NS_FATAL_ERROR ("Cannot create the pipes to " << argv[0] << ": " << std::strerror (errno));
+    }
+
+  m_pid = fork ();
+  if (m_pid < 0)
+    {
+      NS_FATAL_ERROR ("fork () failed: " << std::strerror (errno));
+    }
+  if (m_pid == 0)
+    {
+      if (dup2 (data[1], STDIN_FILENO) >= 0 && dup2 (fd, STDOUT_FILENO) >= 0)
+        {
+          execvp (argv[0], const_cast<char *const *> (&argv[0]));
+        }
+      int error = errno;
+      ssize_t written = write (status[1], &error, sizeof (error));
+      _exit (written == sizeof (error) ? 127 : 126);
+    }
+  close (data[1]);
+  close (status[1]);
+  close (fd);
+  m_fd = data[0];
+
+  // Nothing to read means the exec succeeded and closed the write end
+  int error;
+  ssize_t n;
+  while ((n = read (status[0], &error, sizeof (error))) < 0 && errno == EINTR)
+    {
+    }
+  close (status[0]);
+  if (n == sizeof (error))
+    {
+      waitpid (m_pid, 0, 0);
+      unlink (m_filename.c_str ());
+      NS_FATAL_ERROR ("Cannot run pcap compressor " << argv[0] << ": " << std::strerror (error));
+    }
+}
+
+CompressedPcapFile::~CompressedPcapFile ()
+{
+  Flush ();
+  if (close (m_fd) != 0)
+    {
+      NS_FATAL_ERROR ("Cannot write " << m_filename << ": " << std::strerror (errno));
+    }
+  if (m_pid > 0)
+    {
+      int status;
+      if (waitpid (m_pid, &status, 0) != m_pid || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          NS_FATAL_ERROR ("Pcap compressor writing " << m_filename << " did not exit cleanly");
+        }
+    }
+}
+
+void
+CompressedPcapFile::Put (const void *data, size_t size)
+{
+  if (m_out.size () + size > BUFFER_SIZE)
+    {
+      Flush ();
+    }
+  const uint8_t *bytes = static_cast<const uint8_t *> (data);
+  m_out.insert (m_out.end (), bytes, bytes + size);
+}
+
+void
+CompressedPcapFile::Flush (void)
+{
+  size_t done = 0;
+  while (done < m_out.size ())
+    {
+      ssize_t n = m_pid > 0
+        ? send (m_fd, m_out.data () + done, m_out.size () - done, MSG_NOSIGNAL)
+        : write (m_fd, m_out.data () + done, m_out.size () - done);
+      if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (n < 0)
+        {
+          NS_FATAL_ERROR ((errno == EPIPE ? "Pcap compressor writing " + m_filename + " exited early"
+                           : "Cannot write " + m_filename + ": " + std::strerror (errno)));
+        }
+      done += n;
+    }
+  m_out.clear ();
+}
+
+void
+CompressedPcapFile::SetFilter (const TraceFilter *filter)
+{
+  m_filter = filter;
+}
+
+void
+CompressedPcapFile::Write (Ptr<const Packet> packet)
+{
+  if (m_filter && !m_filter->Accepts (packet, m_linkType))
+    {
+      return;
+    }
+  uint32_t size = packet->GetSize ();
+  uint32_t captured = size < SNAP_LEN ? size : SNAP_LEN;
+  m_buffer.resize (captured);
+  packet->CopyData (m_buffer.data (), captured);
+
+  int64_t us = Simulator::Now ().GetMicroSeconds ();
+  uint32_t record[4] = { uint32_t (us / 1000000), uint32_t (us % 1000000), captured, size };
+  Put (record, sizeof (record));
+  Put (m_buffer.data (), captured);
+}
+
+void
+CompressedPcapFile::PacketSniffer (CompressedPcapFile *file, Ptr<const Packet> packet)
+{
+  file->Write (packet);
+}
+
+void
+CompressedPcapFile::WifiRxSniffer (CompressedPcapFile *file, Ptr<const Packet> packet, uint16_t channelFreqMhz,
+                                   WifiTxVector txVector, MpduInfo aMpdu, SignalNoiseDbm signalNoise)
+{
+  file->Write (packet);
+}
+
+void
+CompressedPcapFile::WifiTxSniffer (CompressedPcapFile *file, Ptr<const Packet> packet, uint16_t channelFreqMhz,
+                                   WifiTxVector txVector, MpduInfo aMpdu)
+{
+  file->Write (packet);
+}
+
+/// The PcapHelper file name of device: prefix-node-device.pcap
+static std::string
+PcapFileName (std::string prefix, Ptr<NetDevice> device)
+{
+  std::ostringstream oss;
+  oss << prefix << "-" << device->GetNode ()->GetId () << "-" << device->GetIfIndex () << ".pcap";
+  return oss.str ();
+}
+
+/**
+ * Capture device the way PcapHelper would, through a CompressedPcapFile
+ * with filter applied.
+ *
+ * \return the file, to be deleted after Simulator::Destroy, or 0 if the
+ * filter excludes device
+ */
+static CompressedPcapFile *
+EnableFilteredPcap (std::string prefix, Ptr<NetDevice> device, std::string compressor, const TraceFilter *filter)
+{
+  if (!filter->AcceptsDevice (device))
+    {
+      return 0;
+    }
+  CompressedPcapFile *file;
+  Ptr<WifiNetDevice> wifi = DynamicCast<WifiNetDevice> (device);
+  if (wifi)
+    {
+      file = new CompressedPcapFile (PcapFileName (prefix, device), compressor, PcapHelper::DLT_IEEE802_11);
+      wifi->GetPhy ()->TraceConnectWithoutContext ("MonitorSnifferRx", MakeBoundCallback (&CompressedPcapFile::WifiRxSniffer, file));
+      wifi->GetPhy ()->TraceConnectWithoutContext ("MonitorSnifferTx", MakeBoundCallback (&CompressedPcapFile::WifiTxSniffer, file));
+    }
+  else
+    {
+      uint32_t dataLinkType = DynamicCast<CsmaNetDevice> (device) ? PcapHelper::DLT_EN10MB : PcapHelper::DLT_PPP;
+      file = new CompressedPcapFile (PcapFileName (prefix, device), compressor, dataLinkType);
+      device->TraceConnectWithoutContext ("PromiscSniffer", MakeBoundCallback (&CompressedPcapFile::PacketSniffer, file));
+    }
+  file->SetFilter (filter);
+  return file;
+}
+
 int main (int argc, char *argv[])
 {
   bool verbose = true;
@@ -54,7 +784,27 @@ int main (int argc, char *argv[])
   cmd.AddValue ("verbose", "Tell echo applications to log if true", verbose);
   cmd.AddValue ("tracing", "Enable pcap tracing", tracing);
 
+  double flowmonInterval = 0;
+  std::string flowmonStream = "flowmon-stream.txt";
+  cmd.AddValue ("flowmonInterval", "Append the per flow FlowMonitor counters every this many seconds and reset them, instead of writing the end-of-run dump (0 = off)", flowmonInterval);
+  cmd.AddValue ("flowmonStream", "File the per interval FlowMonitor counters are appended to", flowmonStream);
+  std::string flowmonFormat = "xml";
+  cmd.AddValue ("flowmonFormat", "Final FlowMonitor output: xml (flowmon.xml) or binary (flowmon.bin)", flowmonFormat);
+  bool asyncTrace = false;
+  cmd.AddValue ("asyncTrace", "Write the ascii traces from a background thread", asyncTrace);
+  std::string pcapCompress = "none";
+  cmd.AddValue ("pcapCompress", "Compress the pcap files while writing them: none, gzip or zstd", pcapCompress);
+  bool fastAscii = false;
+  cmd.AddValue ("fastAscii", "Build the ascii trace lines without a stream per field (same output as the trace helpers); the packet is still printed by Packet::Print", fastAscii);
+  std::string traceFilterSpec;
+  cmd.AddValue ("traceFilter", "Only trace matching packets, e.g. \"src=10.1.3.3 dport=9 bidir=1 start=2 stop=5\" (see TraceFilter)", traceFilterSpec);
   cmd.Parse (argc,argv);
+  TraceFilter traceFilter;
+  traceFilter.Parse (traceFilterSpec);
+  if (flowmonFormat != "xml" && flowmonFormat != "binary")
+    {
+      NS_FATAL_ERROR ("Unknown flowmonFormat " << flowmonFormat);
+    }
 
   // The underlying restriction of 18 is due to the grid position
   // allocator's configuration; the grid layout will exceed the
@@ -177,22 +927,70 @@ int main (int argc, char *argv[])
 Ptr<FlowMonitor> flowmonitor;
 FlowMonitorHelper flowhelper;
 flowmonitor=flowhelper.InstallAll();
+  FlowMonitorStreamer *streamer = 0;
+  if (flowmonInterval > 0)
+    {
+      streamer = new FlowMonitorStreamer (flowmonitor, DynamicCast<Ipv4FlowClassifier> (flowhelper.GetClassifier ()),
+                                          flowmonStream, Seconds (flowmonInterval));
+    }
 
   Simulator::Stop (Seconds (10.0));
 
-  if (tracing == true)
+  std::vector<CompressedPcapFile *> pcapFiles;
+  if (tracing == true && pcapCompress == "none" && traceFilter.IsEmpty ())
     {
       pointToPoint.EnablePcapAll ("third");
       phy.EnablePcap ("third", apDevices.Get (0));
       csma.EnablePcap ("third", csmaDevices.Get (0), true);
     }
+  else if (tracing == true)
+    {
+      NetDeviceContainer captured (p2pDevices);
+      captured.Add (csmaDevices.Get (0));
+      captured.Add (apDevices.Get (0));
+      for (uint32_t i = 0; i < captured.GetN (); ++i)
+        {
+          CompressedPcapFile *file = EnableFilteredPcap ("third", captured.Get (i), pcapCompress, &traceFilter);
+          if (file)
+            {
+              pcapFiles.push_back (file);
+            }
+        }
+    }
 
 //Ascii trace
 
 AsciiTraceHelper ascii;
-phy.EnableAsciiAll(ascii.CreateFileStream("phy.tr"));
-csma.EnableAsciiAll(ascii.CreateFileStream("csma.tr"));
-pointToPoint.EnableAsciiAll(ascii.CreateFileStream("p2p.tr"));
+  std::vector<AsyncTraceFile *> asyncTraces;
+  Ptr<OutputStreamWrapper> phyStream;
+  Ptr<OutputStreamWrapper> csmaStream;
+  Ptr<OutputStreamWrapper> p2pStream;
+  if (asyncTrace)
+    {
+      asyncTraces.push_back (new AsyncTraceFile ("phy.tr"));
+      asyncTraces.push_back (new AsyncTraceFile ("csma.tr"));
+      asyncTraces.push_back (new AsyncTraceFile ("p2p.tr"));
+      phyStream = asyncTraces[0]->GetStream ();
+      csmaStream = asyncTraces[1]->GetStream ();
+      p2pStream = asyncTraces[2]->GetStream ();
+    }
+  else
+    {
+      phyStream = ascii.CreateFileStream ("phy.tr");
+      csmaStream = ascii.CreateFileStream ("csma.tr");
+      p2pStream = ascii.CreateFileStream ("p2p.tr");
+    }
+  std::vector<AsciiTraceSink *> asciiSinks;
+  if (traceFilter.IsEmpty () && !fastAscii)
+    {
+      phy.EnableAsciiAll (phyStream);
+      csma.EnableAsciiAll (csmaStream);
+      pointToPoint.EnableAsciiAll (p2pStream);
+    }
+  else
+    {
+      asciiSinks = EnableFilteredAscii (&traceFilter, p2pStream, csmaStream, phyStream);
+    }
 
 //NetAnim
 
@@ -211,9 +1009,35 @@ anim.SetConstantPosition(wifiApNode.Get(0),20.0,50.0);
 
 
   Simulator::Run ();
-
-flowmonitor->SerializeToXmlFile("flowmon.xml",true,true);
+  if (streamer)
+    {
+      streamer->Export ();
+    }
+  else if (flowmonFormat == "binary")
+    {
+      if (!SerializeToBinaryFile (flowmonitor, DynamicCast<Ipv4FlowClassifier> (flowhelper.GetClassifier ()), "flowmon.bin"))
+        {
+          NS_FATAL_ERROR ("Cannot write flowmon.bin");
+        }
+    }
+  else
+    {
+      flowmonitor->SerializeToXmlFile("flowmon.xml",true,true);
+    }
 
   Simulator::Destroy ();
+  delete streamer;
+  for (uint32_t i = 0; i < asyncTraces.size (); ++i)
+    {
+      delete asyncTraces[i];
+    }
+  for (uint32_t i = 0; i < pcapFiles.size (); ++i)
+    {
+      delete pcapFiles[i];
+    }
+  for (uint32_t i = 0; i < asciiSinks.size (); ++i)
+    {
+      delete asciiSinks[i];
+    }
   return 0;
 }
@@ -0,0 +1,605 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Summarizes ascii traces (phy.tr, csma.tr, p2p.tr, ...) and pcap files
+// written by the scripts in this directory:
+//
+//   ./waf --run "trace-analyzer --threads=8 phy.tr csma.tr p2p.tr third-0-0.pcap"
+//
+// Each file is memory-mapped and cut into chunks that end on a line
+// (ascii) or record (pcap) boundary, and the chunks are parsed by a
+// pool of threads. For ascii traces it prints per node and device the
+// transmitted (wifi "t"), received, enqueued, dequeued and dropped
+// packets, the maximum and time-averaged transmit queue occupancy, and
+// an estimate of the wifi airtime. The queue figures are exact: every
+// chunk keeps its occupancy relative to its own start and the chunks
+// are chained in file order afterwards. A device found in several
+// files, e.g. the traces of separate runs, gets the maximum over the
+// files and a mean over the sum of the files' queue spans (first to
+// last queue event of each): the files are taken as separate periods,
+// not chained. The airtime is computed from the mode and the frame
+// length found in the printed headers plus a fixed preamble per
+// modulation, so it is an approximation. For pcap files (PPP, Ethernet,
+// 802.11 and radiotap link types) it prints the number of records,
+// bytes and IPv4, UDP and TCP packets. pcapng files and gzip or zstd
+// compressed traces are reported and skipped.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/// What one device did within one chunk of an ascii trace
+struct DeviceStats
+{
+  DeviceStats ()
+    : tx (0), rx (0), enqueue (0), dequeue (0), drop (0),
+      airtime (0),
+      level (0), maxLevel (0),
+      firstTime (0), lastTime (0), area (0), span (0)
+  {
+  }
+
+  uint64_t tx;
+  uint64_t rx;
+  uint64_t enqueue;
+  uint64_t dequeue;
+  uint64_t drop;
+  double airtime;       //!< seconds
+
+  // queue occupancy, relative to the level at the first event of the chunk
+  int64_t level;        //!< at the last event
+  int64_t maxLevel;
+  double firstTime;     //!< of the first queue event
+  double lastTime;      //!< of the last queue event
+  double area;          //!< occupancy integrated over [firstTime, lastTime]
+  double span;          //!< sum of lastTime - firstTime over the files merged
+  bool HasQueueEvents (void) const
+  {
+    return enqueue + dequeue > 0;
+  }
+};
+
+/// node id in the upper, device index in the lower 32 bits
+typedef std::map<uint64_t, DeviceStats> DeviceMap;
+
+/// What one chunk of a pcap file contains
+struct PcapStats
+{
+  PcapStats ()
+    : records (0), bytes (0), ipv4 (0), udp (0), tcp (0)
+  {
+  }
+  uint64_t records;
+  uint64_t bytes;
+  uint64_t ipv4;
+  uint64_t udp;
+  uint64_t tcp;
+};
+
+struct Chunk
+{
+  const char *begin;
+  const char *end;
+};
+
+static const char *
+Find (const char *begin, const char *end, const char *needle)
+{
+  const char *found = std::search (begin, end, needle, needle + std::strlen (needle));
+  return found == end ? 0 : found;
+}
+
+static uint64_t
+ParseUnsigned (const char *&p, const char *end)
+{
+  uint64_t value = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+    {
+      value = value * 10 + (*p - '0');
+      ++p;
+    }
+  return value;
+}
+
+/**
+ * Rough airtime of the wifi frame printed in [packet, end) at mode, e.g.
+ * DsssRate11Mbps or OfdmRate24Mbps: preamble plus length over rate.
+ */
+static double
+WifiAirtime (const char *mode, const char *modeEnd, const char *packet, const char *end)
+{
+  const char *rate = Find (mode, modeEnd, "Rate");
+  if (rate == 0)
+    {
+      return 0;
+    }
+  rate += 4;
+  double mbps = ParseUnsigned (rate, modeEnd);
+  if (rate < modeEnd && *rate == '_')
+    {
+      ++rate;
+      mbps += ParseUnsigned (rate, modeEnd) / 10.0;
+    }
+  if (mbps <= 0)
+    {
+      return 0;
+    }
+  double preamble = std::strncmp (mode, "Dsss", 4) == 0 ? 192e-6 : std::strncmp (mode, "Ht", 2) == 0 ? 36e-6 : 20e-6;
+
+  uint32_t bytes;
+  const char *mac = Find (packet, end, "WifiMacHeader (");
+  const char *type = mac ? mac + std::strlen ("WifiMacHeader (") : end;
+  const char *ip = Find (packet, end, "Ipv4Header (");
+  const char *length = ip ? Find (ip, end, "length: ") : 0;
+  const char *size = Find (packet, end, "size=");
+  if (type + 7 <= end && (std::strncmp (type, "CTL_ACK", 7) == 0 || std::strncmp (type, "CTL_CTS", 7) == 0))
+    {
+      bytes = 14;
+    }
+  else if (type + 7 <= end && std::strncmp (type, "CTL_RTS", 7) == 0)
+    {
+      bytes = 20;
+    }
+  else if (length)
+    {
+      length += std::strlen ("length: ");
+      bool qos = type + 7 <= end && std::strncmp (type, "QOSDATA", 7) == 0;
+      bytes = ParseUnsigned (length, end) + 8 + (qos ? 26 : 24) + 4;
+    }
+  else if (size)
+    {
+      size += std::strlen ("size=");
+      bytes = ParseUnsigned (size, end) + 24 + 4;
+    }
+  else
+    {
+      bytes = 24 + 4;
+    }
+  return preamble + bytes * 8 / (mbps * 1e6);
+}
+
+/// Parse the ascii trace lines in chunk; the chunk starts at a line start
+static void
+ParseAsciiChunk (Chunk chunk, DeviceMap &devices)
+{
+  const char *p = chunk.begin;
+  while (p < chunk.end)
+    {
+      const char *eol = static_cast<const char *> (std::memchr (p, '\n', chunk.end - p));
+      if (eol == 0)
+        {
+          eol = chunk.end;
+        }
+      const char *line = p;
+      p = eol + 1;
+
+      char event = line[0];
+      if (eol - line < 4 || line[1] != ' ' || event == 0 || std::strchr ("+-drt", event) == 0)
+        {
+          continue;
+        }
+      // strtod needs a terminated string, the mapping is not
+      char timeText[32];
+      const char *timeEnd = static_cast<const char *> (std::memchr (line + 2, ' ', eol - line - 2));
+      if (timeEnd == 0 || timeEnd - line - 2 >= int32_t (sizeof (timeText)))
+        {
+          continue;
+        }
+      std::memcpy (timeText, line + 2, timeEnd - line - 2);
+      timeText[timeEnd - line - 2] = 0;
+      double time = std::strtod (timeText, 0);
+      const char *context = timeEnd + 1;
+      if (context >= eol || std::strncmp (context, "/NodeList/", 10) != 0)
+        {
+          continue;
+        }
+      const char *q = context + 10;
+      uint64_t node = ParseUnsigned (q, eol);
+      if (eol - q < 12 || std::strncmp (q, "/DeviceList/", 12) != 0)
+        {
+          continue;
+        }
+      q += 12;
+      uint64_t device = ParseUnsigned (q, eol);
+      const char *contextEnd = static_cast<const char *> (std::memchr (q, ' ', eol - q));
+      if (contextEnd == 0)
+        {
+          continue;
+        }
+
+      DeviceStats &s = devices[(node << 32) | device];
+      switch (event)
+        {
+        case 'r':
+          ++s.rx;
+          break;
+        case 'd':
+          ++s.drop;
+          break;
+        case 't':
+          {
+            ++s.tx;
+            const char *mode = contextEnd + 1;
+            const char *modeEnd = static_cast<const char *> (std::memchr (mode, ' ', eol - mode));
+            if (modeEnd)
+              {
+                s.airtime += WifiAirtime (mode, modeEnd, modeEnd + 1, eol);
+              }
+          }
+          break;
+        case '+':
+        case '-':
+          if (!s.HasQueueEvents ())
+            {
+              s.firstTime = time;
+            }
+          else
+            {
+              s.area += s.level * (time - s.lastTime);
+            }
+          s.lastTime = time;
+          if (event == '+')
+            {
+              ++s.enqueue;
+              s.maxLevel = std::max (s.maxLevel, ++s.level);
+            }
+          else
+            {
+              ++s.dequeue;
+              --s.level;
+            }
+          break;
+        }
+    }
+}
+
+/// Offset of the IPv4 header in a frame of the pcap link type, or -1
+static int32_t
+Ipv4Offset (uint32_t linkType, const uint8_t *b, uint32_t n)
+{
+  switch (linkType)
+    {
+    case 9:                     // PPP
+      return n >= 2 && b[0] == 0x00 && b[1] == 0x21 ? 2 : -1;
+    case 1:                     // Ethernet
+      if (n >= 14 && ((b[12] << 8) | b[13]) == 0x0800)
+        {
+          return 14;
+        }
+      if (n >= 22 && ((b[12] << 8) | b[13]) < 1536 && ((b[20] << 8) | b[21]) == 0x0800)
+        {
+          return 22;
+        }
+      return -1;
+    case 127:                   // radiotap, then 802.11
+      {
+        // The radiotap header carries its own length, little-endian
+        uint32_t len = n >= 4 ? (b[2] | (b[3] << 8)) : 0;
+        if (len < 8 || len > n)
+          {
+            return -1;
+          }
+        int32_t ip = Ipv4Offset (105, b + len, n - len);
+        return ip < 0 ? -1 : int32_t (len) + ip;
+      }
+    case 105:                   // 802.11
+      {
+        if (n < 2 || ((b[0] >> 2) & 3) != 2)
+          {
+            return -1;
+          }
+        uint32_t ip = 24 + (b[0] & 0x80 ? 2 : 0) + ((b[1] & 3) == 3 ? 6 : 0) + 8;
+        return n >= ip && ((b[ip - 2] << 8) | b[ip - 1]) == 0x0800 ? int32_t (ip) : -1;
+      }
+    default:
+      return -1;
+    }
+}
+
+/// Parse the pcap records in chunk; the chunk starts at a record header
+static void
+ParsePcapChunk (Chunk chunk, uint32_t linkType, bool swapped, PcapStats &stats)
+{
+  const char *p = chunk.begin;
+  while (p + 16 <= chunk.end)
+    {
+      uint32_t captured;
+      uint32_t length;
+      std::memcpy (&captured, p + 8, 4);
+      std::memcpy (&length, p + 12, 4);
+      if (swapped)
+        {
+          captured = __builtin_bswap32 (captured);
+          length = __builtin_bswap32 (length);
+        }
+      const uint8_t *data = reinterpret_cast<const uint8_t *> (p + 16);
+      p += 16 + captured;
+      if (p > chunk.end)
+        {
+          break;
+        }
+      ++stats.records;
+      stats.bytes += length;
+      int32_t ip = Ipv4Offset (linkType, data, captured);
+      if (ip >= 0 && captured >= uint32_t (ip) + 20 && (data[ip] >> 4) == 4)
+        {
+          ++stats.ipv4;
+          stats.udp += data[ip + 9] == 17;
+          stats.tcp += data[ip + 9] == 6;
+        }
+    }
+}
+
+/// Run work (i) for i in [0, n) on up to nThreads threads
+template <typename F>
+static void
+ParallelFor (uint32_t n, uint32_t nThreads, F work)
+{
+  std::atomic<uint32_t> next (0);
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < std::min (n, nThreads); ++t)
+    {
+      threads.push_back (std::thread ([&next, n, &work] ()
+        {
+          for (uint32_t i = next++; i < n; i = next++)
+            {
+              work (i);
+            }
+        }));
+    }
+  for (uint32_t t = 0; t < threads.size (); ++t)
+    {
+      threads[t].join ();
+    }
+}
+
+/// Chain the per chunk results of one file, in file order, into total
+static void
+MergeChunks (std::vector<DeviceMap> const &chunks, DeviceMap &total)
+{
+  DeviceMap file;
+  for (uint32_t c = 0; c < chunks.size (); ++c)
+    {
+      for (DeviceMap::const_iterator i = chunks[c].begin (); i != chunks[c].end (); ++i)
+        {
+          DeviceStats const &in = i->second;
+          DeviceStats &out = file[i->first];
+          if (in.HasQueueEvents ())
+            {
+              if (out.HasQueueEvents ())
+                {
+                  out.area += out.level * (in.firstTime - out.lastTime);
+                }
+              else
+                {
+                  out.firstTime = in.firstTime;
+                }
+              out.area += in.area + out.level * (in.lastTime - in.firstTime);
+              out.maxLevel = std::max (out.maxLevel, out.level + in.maxLevel);
+              out.level += in.level;
+              out.lastTime = in.lastTime;
+            }
+          out.tx += in.tx;
+          out.rx += in.rx;
+          out.enqueue += in.enqueue;
+          out.dequeue += in.dequeue;
+          out.drop += in.drop;
+          out.airtime += in.airtime;
+        }
+    }
+  for (DeviceMap::const_iterator i = file.begin (); i != file.end (); ++i)
+    {
+      DeviceStats &out = total[i->first];
+      out.tx += i->second.tx;
+      out.rx += i->second.rx;
+      out.enqueue += i->second.enqueue;
+      out.dequeue += i->second.dequeue;
+      out.drop += i->second.drop;
+      out.airtime += i->second.airtime;
+      if (i->second.HasQueueEvents ())
+        {
+          // The files are not chained: each adds its own span
+          out.span += i->second.lastTime - i->second.firstTime;
+          out.area += i->second.area;
+          out.maxLevel = std::max (out.maxLevel, i->second.maxLevel);
+        }
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t nThreads = std::max (1u, std::thread::hardware_concurrency ());
+  std::vector<std::string> files;
+  for (int a = 1; a < argc; ++a)
+    {
+      if (std::strncmp (argv[a], "--threads=", 10) == 0)
+        {
+          nThreads = std::max (1, std::atoi (argv[a] + 10));
+        }
+      else
+        {
+          files.push_back (argv[a]);
+        }
+    }
+  if (files.empty ())
+    {
+      std::cerr << "usage: trace-analyzer [--threads=N] FILE..." << std::endl;
+      return 1;
+    }
+
+  DeviceMap devices;
+  for (uint32_t f = 0; f < files.size (); ++f)
+    {
+      int fd = open (files[f].c_str (), O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat (fd, &st) != 0)
+        {
+          std::cerr << "cannot open " << files[f] << ", skipped" << std::endl;
+          if (fd >= 0)
+            {
+              close (fd);
+            }
+          continue;
+        }
+      if (st.st_size == 0)
+        {
+          close (fd);
+          continue;
+        }
+      void *map = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close (fd);
+      if (map == MAP_FAILED)
+        {
+          std::cerr << "cannot map " << files[f] << ", skipped" << std::endl;
+          continue;
+        }
+      madvise (map, st.st_size, MADV_SEQUENTIAL);
+      const char *begin = static_cast<const char *> (map);
+      const char *end = begin + st.st_size;
+
+      const unsigned char *head = reinterpret_cast<const unsigned char *> (begin);
+      const char *unsupported = 0;
+      if (st.st_size >= 4 && head[0] == 0x0a && head[1] == 0x0d && head[2] == 0x0d && head[3] == 0x0a)
+        {
+          unsupported = "pcapng";
+        }
+      else if (st.st_size >= 2 && head[0] == 0x1f && head[1] == 0x8b)
+        {
+          unsupported = "gzip";
+        }
+      else if (st.st_size >= 4 && head[0] == 0x28 && head[1] == 0xb5 && head[2] == 0x2f && head[3] == 0xfd)
+        {
+          unsupported = "zstd";
+        }
+      if (unsupported)
+        {
+          std::cerr << files[f] << " is " << unsupported << ", which is not supported, skipped" << std::endl;
+          munmap (map, st.st_size);
+          continue;
+        }
+
+      uint32_t magic = 0;
+      if (st.st_size >= 24)
+        {
+          std::memcpy (&magic, begin, 4);
+        }
+      bool swapped = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+      if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d || swapped)
+        {
+          uint32_t linkType;
+          std::memcpy (&linkType, begin + 20, 4);
+          if (swapped)
+            {
+              linkType = __builtin_bswap32 (linkType);
+            }
+          // Only the record headers are touched to find the chunk boundaries
+          std::vector<Chunk> chunks;
+          const char *p = begin + 24;
+          const char *chunkBegin = p;
+          uint64_t records = 0;
+          while (p + 16 <= end)
+            {
+              uint32_t captured;
+              std::memcpy (&captured, p + 8, 4);
+              p += 16 + (swapped ? __builtin_bswap32 (captured) : captured);
+              if (++records % 65536 == 0)
+                {
+                  Chunk chunk = { chunkBegin, std::min (p, end) };
+                  chunks.push_back (chunk);
+                  chunkBegin = p;
+                }
+            }
+          if (chunkBegin < end)
+            {
+              Chunk chunk = { chunkBegin, end };
+              chunks.push_back (chunk);
+            }
+          std::vector<PcapStats> results (chunks.size ());
+          ParallelFor (chunks.size (), nThreads, [&] (uint32_t i)
+            {
+              ParsePcapChunk (chunks[i], linkType, swapped, results[i]);
+            });
+          PcapStats total;
+          for (uint32_t i = 0; i < results.size (); ++i)
+            {
+              total.records += results[i].records;
+              total.bytes += results[i].bytes;
+              total.ipv4 += results[i].ipv4;
+              total.udp += results[i].udp;
+              total.tcp += results[i].tcp;
+            }
+          std::cout << files[f] << " (pcap, linktype " << linkType << "): " << total.records << " records, "
+                    << total.bytes << " bytes, " << total.ipv4 << " IPv4, " << total.udp << " UDP, "
+                    << total.tcp << " TCP" << std::endl;
+        }
+      else
+        {
+          uint64_t chunkSize = std::max<uint64_t> (1 << 20, st.st_size / (nThreads * 4) + 1);
+          std::vector<Chunk> chunks;
+          const char *chunkBegin = begin;
+          while (chunkBegin < end)
+            {
+              const char *chunkEnd = chunkBegin + std::min<uint64_t> (chunkSize, end - chunkBegin);
+              const char *eol = static_cast<const char *> (std::memchr (chunkEnd, '\n', end - chunkEnd));
+              chunkEnd = eol ? eol + 1 : end;
+              Chunk chunk = { chunkBegin, chunkEnd };
+              chunks.push_back (chunk);
+              chunkBegin = chunkEnd;
+            }
+          std::vector<DeviceMap> results (chunks.size ());
+          ParallelFor (chunks.size (), nThreads, [&] (uint32_t i)
+            {
+              ParseAsciiChunk (chunks[i], results[i]);
+            });
+          MergeChunks (results, devices);
+        }
+      munmap (map, st.st_size);
+    }
+
+  if (devices.empty ())
+    {
+      return 0;
+    }
+  std::cout << std::setw (6) << "node" << std::setw (8) << "device"
+            << std::setw (10) << "tx" << std::setw (10) << "rx"
+            << std::setw (10) << "enqueue" << std::setw (10) << "dequeue" << std::setw (10) << "drop"
+            << std::setw (10) << "maxQueue" << std::setw (12) << "meanQueue"
+            << std::setw (12) << "airtime(s)" << std::endl;
+  for (DeviceMap::const_iterator i = devices.begin (); i != devices.end (); ++i)
+    {
+      DeviceStats const &s = i->second;
+      double span = s.span;
+      std::cout << std::setw (6) << (i->first >> 32) << std::setw (8) << (i->first & 0xffffffff)
+                << std::setw (10) << s.tx << std::setw (10) << s.rx
+                << std::setw (10) << s.enqueue << std::setw (10) << s.dequeue << std::setw (10) << s.drop
+                << std::setw (10) << s.maxLevel << std::setw (12) << (span > 0 ? s.area / span : 0)
+                << std::setw (12) << s.airtime << std::endl;
+    }
+  return 0;
+}
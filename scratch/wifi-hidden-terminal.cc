@@ -34,6 +34,7 @@
 #include "ns3/mobility-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/yans-wifi-helper.h"
+#include "ns3/spectrum-wifi-helper.h"
 #include "ns3/ssid.h"
 #include "ns3/netanim-module.h"
 #include "ns3/flow-monitor.h"
@@ -42,12 +43,23 @@
 #include "ns3/on-off-helper.h"
 #include "ns3/propagation-loss-model.h"
 #include "ns3/propagation-delay-model.h"
+#include "child-processes.h"
+#include "dense-matrix-propagation-loss-model.h"
+#include "static-neighbour-channel.h"
+
+#include <functional>
 
 using namespace ns3;
 using namespace std;
 
-/// Run single 10 seconds experiment
-void experiment (bool enableCtsRts, string wifiManager)
+/**
+ * Run single 10 seconds experiment
+ *
+ * With staticChannel the PHYs share a StaticNeighbourSpectrumChannel,
+ * which precomputes every link budget of the fixed topology, instead
+ * of a YansWifiChannel.
+ */
+void experiment (bool enableCtsRts, string wifiManager, bool staticChannel)
 {
   // 0. Enable or disable CTS/RTS
   UintegerValue ctsThr = (enableCtsRts ? UintegerValue (100) : UintegerValue (2200));
@@ -64,25 +76,38 @@ void experiment (bool enableCtsRts, string wifiManager)
     }
 
   // 3. Create propagation loss matrix
-  Ptr<MatrixPropagationLossModel> lossModel = CreateObject<MatrixPropagationLossModel> ();
+  Ptr<DenseMatrixPropagationLossModel> lossModel = CreateObject<DenseMatrixPropagationLossModel> ();
   //lossModel->SetDefaultLoss (200); // set default loss to 200 dB (no link)
   lossModel->SetLoss (nodes.Get (0)->GetObject<MobilityModel> (), nodes.Get (1)->GetObject<MobilityModel> (), 50); // set symmetric loss 0 <-> 1 to 50 dB
   lossModel->SetLoss (nodes.Get (2)->GetObject<MobilityModel> (), nodes.Get (1)->GetObject<MobilityModel> (), 50); // set symmetric loss 2 <-> 1 to 50 dB
 
-  // 4. Create & setup wifi channel
-  Ptr<YansWifiChannel> wifiChannel = CreateObject <YansWifiChannel> ();
-  wifiChannel->SetPropagationLossModel (lossModel);
-  wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
-
-  // 5. Install wireless devices
+  // 4. Create & setup wifi channel & 5. Install wireless devices
   WifiHelper wifi;
   wifi.SetStandard (WIFI_PHY_STANDARD_80211b);
   wifi.SetRemoteStationManager ("ns3::" + wifiManager + "WifiManager");
-  YansWifiPhyHelper wifiPhy =  YansWifiPhyHelper::Default ();
-  wifiPhy.SetChannel (wifiChannel);
   WifiMacHelper wifiMac;
   wifiMac.SetType ("ns3::AdhocWifiMac"); // use ad-hoc MAC
-  NetDeviceContainer devices = wifi.Install (wifiPhy, wifiMac, nodes);
+  NetDeviceContainer devices;
+  if (staticChannel)
+    {
+      Ptr<StaticNeighbourSpectrumChannel> wifiChannel = CreateObject<StaticNeighbourSpectrumChannel> ();
+      wifiChannel->AddPropagationLossModel (lossModel);
+      wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
+
+      SpectrumWifiPhyHelper wifiPhy = SpectrumWifiPhyHelper::Default ();
+      wifiPhy.SetChannel (wifiChannel);
+      devices = wifi.Install (wifiPhy, wifiMac, nodes);
+    }
+  else
+    {
+      Ptr<YansWifiChannel> wifiChannel = CreateObject <YansWifiChannel> ();
+      wifiChannel->SetPropagationLossModel (lossModel);
+      wifiChannel->SetPropagationDelayModel (CreateObject <ConstantSpeedPropagationDelayModel> ());
+
+      YansWifiPhyHelper wifiPhy =  YansWifiPhyHelper::Default ();
+      wifiPhy.SetChannel (wifiChannel);
+      devices = wifi.Install (wifiPhy, wifiMac, nodes);
+    }
 
   // uncomment the following to have athstats output
   // AthstatsHelper athstats;
@@ -146,7 +171,7 @@ void experiment (bool enableCtsRts, string wifiManager)
 
   // 9. Run simulation for 10 seconds
   Simulator::Stop (Seconds (3));
-AnimationInterface anim("hidden.xml");
+AnimationInterface anim(enableCtsRts ? "hidden-rtscts.xml" : "hidden-basic.xml");
 
 anim.SetConstantPosition(nodes.Get(0),0.0,0.0);
 anim.SetConstantPosition(nodes.Get(1),10.0,0.0);
@@ -189,13 +214,30 @@ int main (int argc, char **argv)
   string wifiManager ("Ideal");
   CommandLine cmd;
   cmd.AddValue ("wifiManager", "Set wifi rate manager (Aarf, Aarfcd, Amrr, Arf, Cara, Ideal, Minstrel, Onoe, Rraa)", wifiManager);
+  bool parallel = true;
+  cmd.AddValue ("parallel", "Run the RTS/CTS disabled and enabled experiments concurrently", parallel);
+  bool staticChannel = false;
+  cmd.AddValue ("staticChannel", "Use a spectrum channel that precomputes the link budgets of the static topology", staticChannel);
   cmd.Parse (argc, argv);
 
-  cout << "Hidden station experiment with RTS/CTS disabled:\n" << flush;
-  experiment (false, wifiManager);
+  if (!parallel)
+    {
+      cout << "Hidden station experiment with RTS/CTS disabled:\n" << flush;
+      experiment (false, wifiManager, staticChannel);
+      cout << "------------------------------------------------\n";
+      cout << "Hidden station experiment with RTS/CTS enabled:\n";
+      experiment (true, wifiManager, staticChannel);
+      return 0;
+    }
+
+  vector<function<void ()> > jobs;
+  jobs.push_back (bind (&experiment, false, wifiManager, staticChannel));
+  jobs.push_back (bind (&experiment, true, wifiManager, staticChannel));
+  vector<string> output = RunInChildren (jobs);
+
+  cout << "Hidden station experiment with RTS/CTS disabled:\n" << output[0];
   cout << "------------------------------------------------\n";
-  cout << "Hidden station experiment with RTS/CTS enabled:\n";
-  experiment (true, wifiManager);
+  cout << "Hidden station experiment with RTS/CTS enabled:\n" << output[1];
 
   return 0;
 }